@@ -0,0 +1,250 @@
+#ifndef ISOTRACKFINDER_TRACKISOLATIONALGO_H
+#define ISOTRACKFINDER_TRACKISOLATIONALGO_H
+
+//-----------------------------------------------------------------------------------------
+//
+// The trackIsolation of TrackIsolationMaker, without the framework: the pt sum of the other
+// charged PFCandidates within the cone and with |dz| <= dzcut, added in the order of the
+// collection. All the cones (and the mini-isolation cone of 10 GeV/pt) are summed in the
+// same pass over the PFCandidates within the largest one.
+//
+// Two algorithms give the same sums, bit by bit:
+//  nestedLoop: the reference, all the pairs
+//  grid:       the neighbours searched in the 3x3 cells of an eta-phi grid around each
+//              PFCandidate, with a vectorised kernel. Cones wider than a third of the
+//              circle get a grid of a single cell
+// Header only, so that test/benchmarkTrackIsolation runs it on synthetic events.
+//-----------------------------------------------------------------------------------------
+
+#include "DataFormats/Math/interface/deltaR.h"
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+class TrackIsolationAlgo {
+public:
+  // a charged PFCandidate: dz is the float of pat::PackedCandidate::dz(pv)
+  struct Candidate {
+    double pt, eta, phi;
+    float dz;
+  };
+
+  // the mini-isolation cone: 10 GeV/pt, within [0.05,0.2]
+  static double miniIsoCone(double pt) { return std::max(0.05, std::min(0.2, 10. / pt)); }
+
+  TrackIsolationAlgo() : dzcut_(0.), miniIso_(false), parallel_(false), searchRadius_(0.) {}
+  // cones: the cones of the sums, miniIso: and the mini-isolation cone after them,
+  // parallel: the selected candidates in chunks on the tbb threads
+  TrackIsolationAlgo(const std::vector<double> & cones, bool miniIso, double dzcut, bool parallel) :
+    cones_(cones), dzcut_(dzcut), miniIso_(miniIso), parallel_(parallel), searchRadius_(0.) {
+    if ( !cones_.empty() ) searchRadius_ = *std::max_element(cones_.begin(), cones_.end());
+    // the largest mini-isolation cone, that of pt -> 0
+    if ( miniIso_ ) searchRadius_ = std::max(searchRadius_, miniIsoCone(0.));
+  }
+
+  size_t nSums() const { return cones_.size() + (miniIso_ ? 1 : 0); }
+
+  // the radii of the sums of a candidate
+  void coneSizes(double pt, std::vector<double> & radii) const {
+    radii.assign(cones_.begin(), cones_.end());
+    if ( miniIso_ ) radii.push_back(miniIsoCone(pt));
+  }
+
+  // isos[s][k]: the sum s of the candidate charged[selected[k]]. charged in the order of the collection
+  void nestedLoop(const std::vector<Candidate> & charged, const std::vector<size_t> & selected,
+		  std::vector<std::vector<float> > & isos) const;
+  void grid(const std::vector<Candidate> & charged, const std::vector<size_t> & selected,
+	    std::vector<std::vector<float> > & isos) const;
+
+private:
+  // f(first, last) over the selected candidates [0,n): in chunks on the tbb threads if parallel_.
+  // Each chunk has its own scratch buffers and only writes the sums of its own candidates, at
+  // their index, so that the results and their order do not depend on the scheduling
+  template <typename F>
+  void forEachRange(size_t n, const F & f) const {
+    const size_t grainSize = 16;
+    if ( parallel_ && n > grainSize )
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, n, grainSize),
+			[&](const tbb::blocked_range<size_t> & range) { f(range.begin(), range.end()); });
+    else
+      f(0, n);
+  }
+
+  // flags the candidates of [0,n) that can be in the cone around (eta0,phi0): a dR^2 cut looser than
+  // the cone and the dz cut. Branch free on contiguous arrays, so that it is vectorised
+  typedef void (*ConeMask)(const double *, const double *, const double *, size_t, double, double, double, double, unsigned char *);
+  static void coneMaskKernel(const double * eta, const double * phi, const double * dz, size_t n,
+			     double eta0, double phi0, double dR2, double dzcut, unsigned char * mask) {
+    for( size_t k = 0; k < n; k++ ) {
+      double deta = eta[k] - eta0;
+      double dphi = phi[k] - phi0;
+      // phi in [-pi,pi]: one turn at most
+      double turn = ( dphi > M_PI ? -2.*M_PI : 0. ) + ( dphi < -M_PI ? 2.*M_PI : 0. );
+      dphi += turn;
+      double dz0 = std::fabs(dz[k]);
+      // the test of the nested loop, which keeps a NaN dz
+      mask[k] = ( deta*deta + dphi*dphi <= dR2 ? 1 : 0 ) & ( !(dz0 > dzcut) ? 1 : 0 );
+    }
+  }
+  __attribute__((target("avx2")))
+  static void coneMaskAVX2(const double * eta, const double * phi, const double * dz, size_t n,
+			   double eta0, double phi0, double dR2, double dzcut, unsigned char * mask) {
+    coneMaskKernel(eta, phi, dz, n, eta0, phi0, dR2, dzcut, mask);
+  }
+  static void coneMaskScalar(const double * eta, const double * phi, const double * dz, size_t n,
+			     double eta0, double phi0, double dR2, double dzcut, unsigned char * mask) {
+    coneMaskKernel(eta, phi, dz, n, eta0, phi0, dR2, dzcut, mask);
+  }
+  // the AVX2 build of the kernel if the cpu has it
+  static ConeMask coneMask() {
+    static const ConeMask mask = selectConeMask();
+    return mask;
+  }
+  static ConeMask selectConeMask() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? &coneMaskAVX2 : &coneMaskScalar;
+  }
+
+  std::vector<double> cones_;
+  double dzcut_;
+  bool miniIso_;
+  bool parallel_;
+  double searchRadius_;
+};
+
+// the reference: loop over all the other charged candidates
+inline void TrackIsolationAlgo::nestedLoop(const std::vector<Candidate> & charged, const std::vector<size_t> & selected,
+					   std::vector<std::vector<float> > & isos) const {
+  isos.assign(nSums(), std::vector<float>(selected.size(), 0.));
+  forEachRange(selected.size(), [&](size_t first, size_t last) {
+    std::vector<double> radii;
+    std::vector<float> sums;
+    for( size_t k = first; k < last; k++ ) {
+      size_t i = selected[k];
+      coneSizes(charged[i].pt, radii);
+      sums.assign(radii.size(), 0.0);
+      for( size_t j = 0; j < charged.size(); j++ ) {
+
+	// don't count the candidate in its own isolation sum
+	if( i == j ) continue;
+
+	// cut on dR between the candidates
+	float dR = reco::deltaR(charged[i].eta, charged[i].phi, charged[j].eta, charged[j].phi);
+	if( dR > searchRadius_ ) continue;
+
+	// cut on the candidate dz
+	if( std::fabs(charged[j].dz) > dzcut_ ) continue;
+
+	for( size_t s = 0; s < radii.size(); s++ )
+	  if( !(dR > radii[s]) ) sums[s] += charged[j].pt;
+      }
+      for( size_t s = 0; s < radii.size(); s++ ) isos[s][k] = sums[s];
+    }
+  });
+}
+
+// the charged candidates are copied into arrays ordered by the cells of an eta-phi grid with cells at
+// least as large as the largest cone: the candidates within the cones of a candidate are in the 3x3
+// cells around its own, each a contiguous range of the arrays. The kernel flags the possible neighbours
+// in these ranges, the exact cuts of the nested loop are applied to them, and the ones kept are added
+// in the order of the collection, so that the float sums are the same
+inline void TrackIsolationAlgo::grid(const std::vector<Candidate> & charged, const std::vector<size_t> & selected,
+				     std::vector<std::vector<float> > & isos) const {
+  const ConeMask mask = coneMask();
+
+  // a little margin, for the rounding of the float dR compared to the largest cone
+  const double cellSize = searchRadius_ * (1. + 1.e-5);
+  // a cone larger than a third of the circle gets a single cell
+  int nPhi = cellSize > 0 ? int( 2.*M_PI / cellSize ) : 0;
+  if ( nPhi < 3 ) nPhi = 1;
+  const double phiCellSize = 2.*M_PI / nPhi;
+  // eta beyond +-etaMax is in the first and last bins
+  const double etaMax = 5.;
+  const int nEta = nPhi == 1 ? 1 : std::max(1, int( std::ceil( 2.*etaMax / cellSize ) ));
+  const int nCells = nEta * nPhi;
+
+  struct {
+    double cellSize, phiCellSize, etaMax;
+    int nEta, nPhi;
+    int etaBin(double eta) const { return std::min(nEta-1, std::max(0, int( std::floor( (eta+etaMax) / cellSize ) ))); }
+    int phiBin(double phi) const { int b = int( std::floor( (phi+M_PI) / phiCellSize ) ) % nPhi; return b < 0 ? b+nPhi : b; }
+  } bins = { cellSize, phiCellSize, etaMax, nEta, nPhi };
+
+  // the cells, as ranges of the arrays: first count, then fill
+  const size_t n = charged.size();
+  std::vector<unsigned int> cellStart(nCells+1, 0), cellOf(n);
+  for( size_t j = 0; j < n; j++ ) {
+    cellOf[j] = bins.etaBin(charged[j].eta) * nPhi + bins.phiBin(charged[j].phi);
+    cellStart[cellOf[j]+1]++;
+  }
+  for( int c = 0; c < nCells; c++ ) cellStart[c+1] += cellStart[c];
+
+  std::vector<double> eta(n), phi(n), dz(n), pt(n);
+  std::vector<size_t> index(n);
+  std::vector<unsigned int> filled(cellStart.begin(), cellStart.end()-1);
+  for( size_t j = 0; j < n; j++ ) {
+    unsigned int k = filled[cellOf[j]]++;
+    index[k] = j;
+    eta[k]   = charged[j].eta;
+    phi[k]   = charged[j].phi;
+    dz[k]    = charged[j].dz;
+    pt[k]    = charged[j].pt;
+  }
+
+  const double looseDR2 = cellSize * cellSize;
+  isos.assign(nSums(), std::vector<float>(selected.size(), 0.));
+  // the candidates within the largest cone: index, dR and pt
+  struct Neighbour {
+    size_t index;
+    float dR;
+    double pt;
+    bool operator<(const Neighbour & other) const { return index < other.index; }
+  };
+  forEachRange(selected.size(), [&](size_t first, size_t last) {
+    std::vector<double> radii;
+    std::vector<float> sums;
+    std::vector<unsigned char> flags(n);
+    std::vector<Neighbour> neighbours;
+    for( size_t k = first; k < last; k++ ) {
+      size_t i = selected[k];
+      const double eta0 = charged[i].eta, phi0 = charged[i].phi;
+      coneSizes(charged[i].pt, radii);
+      int etaBin = bins.etaBin(eta0);
+      int phiBin = bins.phiBin(phi0);
+
+      neighbours.clear();
+      for( int e = std::max(0, etaBin-1); e <= std::min(nEta-1, etaBin+1); e++ ) {
+	for( int dp = (nPhi == 1 ? 0 : -1); dp <= (nPhi == 1 ? 0 : 1); dp++ ) {
+	  int c = e * nPhi + (phiBin + dp + nPhi) % nPhi;
+	  size_t begin = cellStart[c], size = cellStart[c+1] - cellStart[c];
+	  if ( size == 0 ) continue;
+	  mask(&eta[begin], &phi[begin], &dz[begin], size, eta0, phi0, looseDR2, dzcut_, &flags[0]);
+	  for( size_t m = 0; m < size; m++ ) {
+	    if ( !flags[m] ) continue;
+	    size_t j = index[begin+m];
+	    // don't count the candidate in its own isolation sum
+	    if( i == j ) continue;
+	    // the exact cut on dR between the candidates
+	    float dR = reco::deltaR(eta0, phi0, eta[begin+m], phi[begin+m]);
+	    if( dR > searchRadius_ ) continue;
+	    Neighbour neighbour = { j, dR, pt[begin+m] };
+	    neighbours.push_back(neighbour);
+	  }
+	}
+      }
+      std::sort(neighbours.begin(), neighbours.end());
+
+      sums.assign(radii.size(), 0.0);
+      for( size_t m = 0; m < neighbours.size(); m++ )
+	for( size_t s = 0; s < radii.size(); s++ )
+	  if( !(neighbours[m].dR > radii[s]) ) sums[s] += neighbours[m].pt;
+      for( size_t s = 0; s < radii.size(); s++ ) isos[s][k] = sums[s];
+    }
+  });
+}
+
+#endif
@@ -18,29 +18,36 @@
 
 // user include files
 #include "FWCore/Framework/interface/Frameworkfwd.h"
-#include "FWCore/Framework/interface/EDProducer.h"
+#include "FWCore/Framework/interface/global/EDProducer.h"
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/Framework/interface/MakerMacros.h"
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
 #include "CommonTools/ParticleFlow/interface/PFPileUpAlgo.h"
 #include "DataFormats/PatCandidates/interface/PackedCandidate.h"
+#include "DataFormats/VertexReco/interface/VertexFwd.h"
+#include "CfANtupler/IsoTrackFinder/interface/TrackIsolationAlgo.h"
 #include "Math/VectorUtil.h"
 
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
 //
 // class decleration
 //
 
-class TrackIsolationMaker : public edm::EDProducer {
+class TrackIsolationMaker : public edm::global::EDProducer<> {
 public:
      explicit TrackIsolationMaker (const edm::ParameterSet&);
      ~TrackIsolationMaker();
 
 private:
-  //  virtual void beginJob() ;
-  virtual void beginJob() ;
-  virtual void beginRun(edm::Run&, const edm::EventSetup&) ;
-  virtual void produce(edm::Event&, const edm::EventSetup&);
-  virtual void endJob() ;
+  // const, and no per-event state in the members: the events of all the streams at once
+  virtual void produce(edm::StreamID, edm::Event&, const edm::EventSetup&) const override;
+  virtual void endJob() override;
+
+  typedef math::XYZPoint Point;
 
   //jmt: what is this?
   //  float getFixGridRho(std::vector<float>& etabins,std::vector<float>& phibins);
@@ -50,11 +57,30 @@ private:
   double dzcut_;
   double minPt_;
   double maxIso_;
+  bool useGrid_;
+  bool validate_;
+
+  // the cones of the isolation sums: dR_ first, then the other dR_ConeSizes, and the products
+  // of the others (pfcandstrkiso0p1, ...). miniIso_: also the cone of 10 GeV/pt (pfcandsminiiso)
+  std::vector<double> cones_;
+  std::vector<std::string> coneLabels_;
+  bool miniIso_;
+  TrackIsolationAlgo algo_;
 
-  edm::InputTag pfCandidatesTag_;
-  edm::InputTag vertexInputTag_;
+  edm::EDGetTokenT<pat::PackedCandidateCollection> pfCandidatesToken_;
+  edm::EDGetTokenT<reco::VertexCollection> vertexToken_;
 
-  const pat::PackedCandidateCollection *pfCandidates;
+  // validateGrid: timing of the two algorithms per bin of charged PFCandidates, and differences,
+  // summed over the job by all the streams
+  struct Timing {
+    Timing() : events(0), candidates(0), grid(0), nested(0) {}
+    unsigned long events, candidates;
+    std::chrono::steady_clock::duration grid, nested;
+  };
+  std::vector<unsigned int> multiplicityBins_;
+  mutable std::mutex validationMutex_;
+  mutable std::vector<Timing> timing_;
+  mutable unsigned long mismatches_;
 
 };
 
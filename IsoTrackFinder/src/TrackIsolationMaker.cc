@@ -33,14 +33,28 @@
 #include "CfANtupler/IsoTrackFinder/interface/TrackIsolationMaker.h"
 #include "DataFormats/Math/interface/deltaR.h"
 #include "DataFormats/Math/interface/deltaPhi.h"
+#include "FWCore/MessageLogger/interface/MessageLogger.h"
 #include "TMath.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
 typedef math::XYZTLorentzVectorF LorentzVector;
-typedef math::XYZPoint Point;
 using namespace reco;
 using namespace edm;
 using namespace std;
 
+namespace {
+  // the products are built in unique_ptr, Event::put of this release takes an auto_ptr
+  template <typename T>
+  void put(edm::Event & iEvent, unique_ptr<T> & product, const string & label) {
+    iEvent.put(auto_ptr<T>(product.release()), label);
+  }
+}
+
 //
 // class decleration
 //
@@ -51,15 +65,43 @@ using namespace std;
 
 TrackIsolationMaker::TrackIsolationMaker(const edm::ParameterSet& iConfig) {
 
-  pfCandidatesTag_		= iConfig.getParameter<InputTag>	("pfCandidatesTag");
-  vertexInputTag_               = iConfig.getParameter<InputTag>        ("vertexInputTag");
+  pfCandidatesToken_		= consumes<pat::PackedCandidateCollection>(iConfig.getParameter<InputTag>("pfCandidatesTag"));
+  vertexToken_                  = consumes<reco::VertexCollection>        (iConfig.getParameter<InputTag>("vertexInputTag"));
   
   dR_               = iConfig.getParameter<double>          ("dR_ConeSize");       // dR value used to define the isolation cone                (default 0.3 )
   dzcut_            = iConfig.getParameter<double>          ("dz_CutValue");       // cut value for dz(trk,vtx) for track to include in iso sum (default 0.05)
   minPt_            = iConfig.getParameter<double>          ("minPt_PFCandidate"); // store PFCandidates with pt above this cut                 (default 0   )
   maxIso_           = iConfig.getParameter<double>          ("maxIso_PFCandidate");// store PFCandidates with iso below this cut                (default 0   )
+  useGrid_          = iConfig.getUntrackedParameter<bool>   ("useGrid", true);     // neighbours searched in an eta-phi grid instead of all the pairs
+  validate_         = iConfig.getUntrackedParameter<bool>   ("validateGrid", false);// also run the other algorithm, compare and time them
+  vector<double> cones = iConfig.getParameter<vector<double> >("dR_ConeSizes");   // more isolation cones, in the same pass          (default none)
+  miniIso_          = iConfig.getParameter<bool>            ("miniIsolation");     // and the mini-isolation cone, 10 GeV/pt within [0.05,0.2] (default false)
+  bool parallel     = iConfig.getUntrackedParameter<bool>   ("parallelIsolation", false);// the selected PFCandidates shared among the tbb threads
+
+  cones_.push_back(dR_);
+  coneLabels_.push_back("");
+  for( size_t c = 0; c < cones.size(); c++ ) {
+    if ( find(cones_.begin(), cones_.end(), cones[c]) != cones_.end() ) continue;
+    // 0.1 -> pfcandstrkiso0p1
+    ostringstream label;
+    label << cones[c];
+    string name = label.str();
+    replace(name.begin(), name.end(), '.', 'p');
+    cones_.push_back(cones[c]);
+    coneLabels_.push_back(name);
+  }
+  algo_ = TrackIsolationAlgo(cones_, miniIso_, dzcut_, parallel);
+
+  unsigned int bins[] = {0, 500, 1000, 1500, 2000, 3000, 4000};
+  multiplicityBins_.assign(bins, bins + sizeof(bins)/sizeof(bins[0]));
+  timing_.resize(multiplicityBins_.size());
+  mismatches_ = 0;
   
   produces<vector<float> >("pfcandstrkiso").setBranchAlias("pfcands_trkiso");
+  for( size_t c = 1; c < cones_.size(); c++ )
+    produces<vector<float> >("pfcandstrkiso" + coneLabels_[c]).setBranchAlias("pfcands_trkiso" + coneLabels_[c]);
+  if ( miniIso_ )
+    produces<vector<float> >("pfcandsminiiso").setBranchAlias("pfcands_miniiso");
   produces<vector<float> >("pfcandsdzpv"  ).setBranchAlias("pfcands_dzpv");
   produces<vector<float> >("pfcandspt"    ).setBranchAlias("pfcands_pt");
   produces<vector<float> >("pfcandseta"   ).setBranchAlias("pfcands_eta");
@@ -73,35 +115,53 @@ TrackIsolationMaker::~TrackIsolationMaker()
 
 }
 
-void  TrackIsolationMaker::beginRun(edm::Run&, const edm::EventSetup& es) {}
-void  TrackIsolationMaker::beginJob() {}
-void  TrackIsolationMaker::endJob()   {}
+void  TrackIsolationMaker::endJob()   {
+  if ( !validate_ ) return;
+  // ns per event of the two algorithms, in bins of the number of charged PFCandidates
+  ostringstream out;
+  out << "TrackIsolationMaker: " << mismatches_ << " isolation sums differ between the grid and the nested loop\n"
+      << "  charged PFCandidates    events    <charged>    grid [ns/event]    nested loop [ns/event]\n";
+  for( size_t b = 0; b < timing_.size(); b++ ) {
+    if ( timing_[b].events == 0 ) continue;
+    ostringstream range;
+    range << multiplicityBins_[b] << "-";
+    if ( b+1 < multiplicityBins_.size() ) range << multiplicityBins_[b+1];
+    out << setw(23) << range.str() << setw(10) << timing_[b].events
+	<< setw(13) << timing_[b].candidates / timing_[b].events
+	<< setw(19) << std::chrono::duration<double, std::nano>(timing_[b].grid).count() / timing_[b].events
+	<< setw(26) << std::chrono::duration<double, std::nano>(timing_[b].nested).count() / timing_[b].events << "\n";
+  }
+  edm::LogVerbatim("TrackIsolationMaker") << out.str();
+}
 
 // ------------ method called to produce the data  ------------
 
-void TrackIsolationMaker::produce(edm::Event& iEvent, const edm::EventSetup& iSetup) {
+void TrackIsolationMaker::produce(edm::StreamID, edm::Event& iEvent, const edm::EventSetup& iSetup) const {
 
-  auto_ptr<vector<float> >  pfcands_trkiso(new vector<float>);
-  auto_ptr<vector<float> >  pfcands_dzpv  (new vector<float>);
-  auto_ptr<vector<float> >  pfcands_pt    (new vector<float>);
-  auto_ptr<vector<float> >  pfcands_eta   (new vector<float>);
-  auto_ptr<vector<float> >  pfcands_phi   (new vector<float>);
-  auto_ptr<vector<int>   >  pfcands_chg   (new vector<int>  );
+  unique_ptr<vector<float> >  pfcands_trkiso(new vector<float>);
+  unique_ptr<vector<float> >  pfcands_dzpv  (new vector<float>);
+  unique_ptr<vector<float> >  pfcands_pt    (new vector<float>);
+  unique_ptr<vector<float> >  pfcands_eta   (new vector<float>);
+  unique_ptr<vector<float> >  pfcands_phi   (new vector<float>);
+  unique_ptr<vector<int>   >  pfcands_chg   (new vector<int>  );
+  // the other cones, then the mini-isolation
+  const size_t nSums = algo_.nSums();
+  vector<vector<float> >    pfcands_isos(nSums);
 
   //---------------------------------
   // get PFCandidate collection
   //---------------------------------
   
   edm::Handle<pat::PackedCandidateCollection> pfCandidatesHandle;
-  iEvent.getByLabel(pfCandidatesTag_, pfCandidatesHandle);
-  pfCandidates  = pfCandidatesHandle.product();
+  iEvent.getByToken(pfCandidatesToken_, pfCandidatesHandle);
+  const pat::PackedCandidateCollection *pfCandidates = pfCandidatesHandle.product();
 
   //---------------------------------
   // get Vertex Collection
   //---------------------------------
   
   Handle<reco::VertexCollection> vertex_h;
-  iEvent.getByLabel(vertexInputTag_, vertex_h);
+  iEvent.getByToken(vertexToken_, vertex_h);
   const reco::VertexCollection *vertices = vertex_h.product();
 
   //-----------------------------------
@@ -124,69 +184,76 @@ void TrackIsolationMaker::produce(edm::Event& iEvent, const edm::EventSetup& iSe
   //must have a good vertex to want to store anything
   if ( firstGoodVertex!=vertices->end() ) {
 
+    const Point & pv = firstGoodVertex->position();
+
     //-------------------------------------------------------------------------------------------------
-    // loop over PFCandidates and calculate the trackIsolation and dz w.r.t. 1st good PV for each one
+    // the charged PFCandidates (those that enter the isolation sums), with their index in the
+    // collection, and the ones we want to store: only store PFCandidate values if pt > minPt
     //-------------------------------------------------------------------------------------------------
-    for( pat::PackedCandidateCollection::const_iterator pf_it = pfCandidates->begin(); pf_it != pfCandidates->end(); pf_it++ ) {
-      
-      //-------------------------------------------------------------------------------------
-      // only store PFCandidate values if pt > minPt
-      //-------------------------------------------------------------------------------------
-      
-      if( pf_it->pt() < minPt_ ) continue;
-      
-      
-      //-------------------------------------------------------
-      // require PFCandidate is charged
-      //-------------------------------------------------------
-      if ( pf_it->charge() == 0 ) continue;
-	
-      //----------------------------------------------------------------------------
-      // now loop over other PFCandidates in the event to calculate trackIsolation
-      //----------------------------------------------------------------------------
-
-      float trkiso = 0.0;
-
-      for( pat::PackedCandidateCollection::const_iterator pf_other = pfCandidates->begin(); pf_other != pfCandidates->end(); pf_other++ ) {
-
-	// don't count the PFCandidate in its own isolation sum
-	if( pf_it == pf_other       ) continue;
-
-	// require the PFCandidate to be charged
-	if( pf_other->charge() == 0 ) continue;
-
-	// cut on dR between the PFCandidates
-	float dR = deltaR(pf_it->eta(), pf_it->phi(), pf_other->eta(), pf_other->phi());
-	if( dR > dR_ ) continue;
-
-	// cut on the PFCandidate dz
-	float dz_other = pf_other->dz(firstGoodVertex->position());
-
-	// if ( pf_other->trackRef().isNonnull()) {
-	//   dz_other = pf_other->trackRef()->dz( firstGoodVertex->position() );
-	// }
-
-	if( fabs(dz_other) > dzcut_ ) continue;
-
-	trkiso += pf_other->pt();
-      }
+    vector<TrackIsolationAlgo::Candidate> charged;
+    vector<size_t> chargedIndex, selected;
+    for( size_t i = 0; i < pfCandidates->size(); i++ ) {
+      const pat::PackedCandidate & pf = (*pfCandidates)[i];
+      if ( pf.charge() == 0 ) continue;
+      TrackIsolationAlgo::Candidate candidate = { pf.pt(), pf.eta(), pf.phi(), float( pf.dz(pv) ) };
+      if ( !(pf.pt() < minPt_) ) selected.push_back(charged.size());
+      charged.push_back(candidate);
+      chargedIndex.push_back(i);
+    }
+
+    //-------------------------------------------------------------------------------------------------
+    // calculate the trackIsolation of the selected PFCandidates
+    //-------------------------------------------------------------------------------------------------
+    vector<vector<float> > isos;
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    if ( useGrid_ ) algo_.grid      (charged, selected, isos);
+    else            algo_.nestedLoop(charged, selected, isos);
+
+    if ( validate_ ) {
+      // run the other algorithm too, and compare the sums bit by bit
+      clock::time_point middle = clock::now();
+      vector<vector<float> > reference;
+      if ( useGrid_ ) algo_.nestedLoop(charged, selected, reference);
+      else            algo_.grid      (charged, selected, reference);
+      clock::time_point stop = clock::now();
+
+      unsigned long mismatches = 0;
+      for( size_t s = 0; s < isos.size(); s++ )
+	for( size_t k = 0; k < isos[s].size(); k++ )
+	  if ( memcmp(&isos[s][k], &reference[s][k], sizeof(float)) != 0 ) mismatches++;
+
+      unsigned int bin = 0;
+      while ( bin+1 < multiplicityBins_.size() && charged.size() >= multiplicityBins_[bin+1] ) bin++;
+      std::lock_guard<std::mutex> lock(validationMutex_);
+      timing_[bin].events++;
+      timing_[bin].candidates += charged.size();
+      timing_[bin].grid   += useGrid_ ? middle-start : stop-middle;
+      timing_[bin].nested += useGrid_ ? stop-middle  : middle-start;
+      mismatches_ += mismatches;
+    }
 
-      // calculate the dz of this candidate
-      float dz_it = pf_it->dz( firstGoodVertex->position() ); //
+    for( size_t k = 0; k < selected.size(); k++ ) {
+      const pat::PackedCandidate & pf = (*pfCandidates)[chargedIndex[selected[k]]];
+      float trkiso = isos[0][k];
+
+      // the dz of this candidate
+      float dz_it = charged[selected[k]].dz;
 
       // if ( pf_it->trackRef().isNonnull()) {
       // 	dz_it = pf_it->trackRef()->dz( firstGoodVertex->position() );
       // }
 
       // key change from Ben's version: want to cut on iso already
-      if ( trkiso / pf_it->pt() < maxIso_) {
-	//	cout<<"\t"<<pf_it->pt()<<" "<<pf_it->eta()<<" "<<pf_it->phi()<<" "<<pf_it->charge()<<" "<<dz_it<<" "<<trkiso / pf_it->pt()<<endl;
+      if ( trkiso / pf.pt() < maxIso_) {
+	//	cout<<"\t"<<pf.pt()<<" "<<pf.eta()<<" "<<pf.phi()<<" "<<pf.charge()<<" "<<dz_it<<" "<<trkiso / pf.pt()<<endl;
 	pfcands_trkiso->push_back(trkiso);
 	pfcands_dzpv->push_back(dz_it);
-	pfcands_pt->push_back(pf_it->pt());
-	pfcands_eta->push_back(pf_it->eta());
-	pfcands_phi->push_back(pf_it->phi());
-	pfcands_chg->push_back(pf_it->charge());
+	pfcands_pt->push_back(pf.pt());
+	pfcands_eta->push_back(pf.eta());
+	pfcands_phi->push_back(pf.phi());
+	pfcands_chg->push_back(pf.charge());
+	for( size_t s = 1; s < nSums; s++ ) pfcands_isos[s].push_back(isos[s][k]);
       }
 
     } //end of loop of pf cands
@@ -194,12 +261,17 @@ void TrackIsolationMaker::produce(edm::Event& iEvent, const edm::EventSetup& iSe
   } //end of if good vtx
 
   // put trkiso and dz values back into event
-  iEvent.put(pfcands_trkiso,"pfcandstrkiso");
-  iEvent.put(pfcands_dzpv  ,"pfcandsdzpv"  );
-  iEvent.put(pfcands_pt    ,"pfcandspt"    );
-  iEvent.put(pfcands_eta   ,"pfcandseta"   );
-  iEvent.put(pfcands_phi   ,"pfcandsphi"   );
-  iEvent.put(pfcands_chg   ,"pfcandschg"   );
+  put(iEvent, pfcands_trkiso,"pfcandstrkiso");
+  put(iEvent, pfcands_dzpv  ,"pfcandsdzpv"  );
+  put(iEvent, pfcands_pt    ,"pfcandspt"    );
+  put(iEvent, pfcands_eta   ,"pfcandseta"   );
+  put(iEvent, pfcands_phi   ,"pfcandsphi"   );
+  put(iEvent, pfcands_chg   ,"pfcandschg"   );
+  for( size_t s = 1; s < nSums; s++ ) {
+    unique_ptr<vector<float> > pfcands_iso(new vector<float>);
+    pfcands_iso->swap(pfcands_isos[s]);
+    put(iEvent, pfcands_iso, s < cones_.size() ? "pfcandstrkiso" + coneLabels_[s] : string("pfcandsminiiso"));
+  }
  
 }
 
@@ -0,0 +1,189 @@
+//-----------------------------------------------------------------------------------------
+//
+// Benchmark of the trackIsolation algorithms of TrackIsolationAlgo on synthetic events:
+// charged PFCandidates from a primary vertex and pileup vertices spread in z, part of them
+// in collimated jets. For each multiplicity, the ns/event of every variant (nested loop,
+// grid, serial and on the tbb threads), and the sums compared bit by bit with the serial
+// nested loop. Returns 1 if any sum differs.
+//
+//   benchmarkTrackIsolation [-events 20] [-min 500] [-max 5000] [-step 500] [-seed 1]
+//                           [-cones 0.3,0.1,0.2,0.4] [-mini] [-dz 0.05] [-minPt 5] [-csv file]
+//-----------------------------------------------------------------------------------------
+
+#include "CfANtupler/IsoTrackFinder/interface/TrackIsolationAlgo.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+  struct Event {
+    vector<TrackIsolationAlgo::Candidate> charged;
+    vector<size_t> selected;
+  };
+
+  // n charged PFCandidates: 30% from the primary vertex, the others from 40 pileup vertices
+  // (z spread of 5 cm, dz resolution of 200 um). Half of those of the primary vertex are in
+  // 2 to 6 jets of width 0.08 in eta and phi, with a harder pt spectrum
+  Event generate(size_t n, double minPt, mt19937 & random) {
+    uniform_real_distribution<double> uniform(0., 1.);
+    normal_distribution<double> gauss(0., 1.);
+    exponential_distribution<double> softPt(1./0.8), jetPt(1./8.);
+
+    const int nPileup = 40;
+    const double zPV = 5. * gauss(random);
+    vector<double> zPileup(nPileup);
+    for( int v = 0; v < nPileup; v++ ) zPileup[v] = 5. * gauss(random);
+
+    const int nJets = 2 + int( 5 * uniform(random) );
+    vector<double> jetEta(nJets), jetPhi(nJets);
+    for( int jet = 0; jet < nJets; jet++ ) {
+      jetEta[jet] = -2.5 + 5. * uniform(random);
+      jetPhi[jet] = M_PI * (2. * uniform(random) - 1.);
+    }
+
+    Event event;
+    for( size_t i = 0; i < n; i++ ) {
+      TrackIsolationAlgo::Candidate candidate;
+      bool primary = uniform(random) < 0.3;
+      double z = primary ? zPV : zPileup[int( nPileup * uniform(random) ) % nPileup];
+      candidate.dz = z - zPV + 0.02 * gauss(random);
+      if ( primary && uniform(random) < 0.5 ) {
+	int jet = int( nJets * uniform(random) ) % nJets;
+	candidate.pt  = 0.5 + jetPt(random);
+	candidate.eta = jetEta[jet] + 0.08 * gauss(random);
+	candidate.phi = jetPhi[jet] + 0.08 * gauss(random);
+	if ( candidate.phi >  M_PI ) candidate.phi -= 2.*M_PI;
+	if ( candidate.phi < -M_PI ) candidate.phi += 2.*M_PI;
+      } else {
+	candidate.pt  = 0.5 + softPt(random);
+	candidate.eta = -2.5 + 5. * uniform(random);
+	candidate.phi = M_PI * (2. * uniform(random) - 1.);
+      }
+      if ( !(candidate.pt < minPt) ) event.selected.push_back(i);
+      event.charged.push_back(candidate);
+    }
+    return event;
+  }
+
+  struct Variant {
+    string name;
+    const TrackIsolationAlgo * algo;
+    bool grid;
+  };
+
+}
+
+int main(int argc, char ** argv) {
+  size_t nEvents = 20, minN = 500, maxN = 5000, step = 500;
+  unsigned int seed = 1;
+  vector<double> cones(1, 0.3);
+  bool miniIso = false;
+  double dzcut = 0.05, minPt = 5.;
+  string csvName;
+  for( int a = 1; a < argc; a++ ) {
+    string option = argv[a];
+    if ( option == "-mini" ) { miniIso = true; continue; }
+    if ( a+1 >= argc ) { cerr << "missing value of " << option << endl; return 2; }
+    string value = argv[++a];
+    if      ( option == "-events" ) nEvents = atoi(value.c_str());
+    else if ( option == "-min"    ) minN    = atoi(value.c_str());
+    else if ( option == "-max"    ) maxN    = atoi(value.c_str());
+    else if ( option == "-step"   ) step    = atoi(value.c_str());
+    else if ( option == "-seed"   ) seed    = atoi(value.c_str());
+    else if ( option == "-dz"     ) dzcut   = atof(value.c_str());
+    else if ( option == "-minPt"  ) minPt   = atof(value.c_str());
+    else if ( option == "-csv"    ) csvName = value;
+    else if ( option == "-cones"  ) {
+      cones.clear();
+      istringstream list(value);
+      string cone;
+      while ( getline(list, cone, ',') ) cones.push_back(atof(cone.c_str()));
+    }
+    else { cerr << "unknown option " << option << endl; return 2; }
+  }
+  if ( step == 0 || cones.empty() ) { cerr << "-step and -cones must not be empty" << endl; return 2; }
+
+  const TrackIsolationAlgo serial  (cones, miniIso, dzcut, false);
+  const TrackIsolationAlgo parallel(cones, miniIso, dzcut, true);
+  Variant variants[] = {
+    { "nested loop",       &serial,   false },
+    { "grid",              &serial,   true  },
+    { "nested loop (tbb)", &parallel, false },
+    { "grid (tbb)",        &parallel, true  }
+  };
+  const size_t nVariants = sizeof(variants)/sizeof(variants[0]);
+
+  cout << "trackIsolation of " << nEvents << " events per multiplicity, " << serial.nSums() << " sums, dz < " << dzcut
+       << ", pt > " << minPt << "\n" << setw(10) << "charged" << setw(11) << "selected";
+  for( size_t v = 0; v < nVariants; v++ ) cout << setw(20) << variants[v].name;
+  cout << "    [ns/event]" << endl;
+
+  ofstream csv;
+  if ( csvName != "" ) {
+    csv.open(csvName.c_str());
+    csv << "charged,selected,variant,ns_per_event,mismatches\n" << fixed << setprecision(1);
+  }
+
+  typedef chrono::steady_clock clock;
+  mt19937 random(seed);
+  vector<unsigned long> mismatches(nVariants, 0);
+  for( size_t n = minN; n <= maxN; n += step ) {
+    vector<Event> events;
+    size_t selected = 0;
+    for( size_t e = 0; e < nEvents; e++ ) {
+      events.push_back(generate(n, minPt, random));
+      selected += events.back().selected.size();
+    }
+
+    // the sums of the reference, the first variant
+    vector<vector<vector<float> > > reference(nEvents);
+    vector<double> nsPerEvent(nVariants, 0.);
+    vector<unsigned long> pointMismatches(nVariants, 0);
+    for( size_t v = 0; v < nVariants; v++ ) {
+      vector<vector<vector<float> > > isos(nEvents);
+      clock::time_point start = clock::now();
+      for( size_t e = 0; e < nEvents; e++ ) {
+	if ( variants[v].grid ) variants[v].algo->grid      (events[e].charged, events[e].selected, isos[e]);
+	else                    variants[v].algo->nestedLoop(events[e].charged, events[e].selected, isos[e]);
+      }
+      nsPerEvent[v] = chrono::duration<double, nano>(clock::now() - start).count() / max(nEvents, size_t(1));
+
+      for( size_t e = 0; e < nEvents; e++ ) {
+	if ( v == 0 ) { reference[e].swap(isos[e]); continue; }
+	for( size_t s = 0; s < isos[e].size(); s++ )
+	  for( size_t k = 0; k < isos[e][s].size(); k++ )
+	    if ( memcmp(&isos[e][s][k], &reference[e][s][k], sizeof(float)) != 0 ) pointMismatches[v]++;
+      }
+      mismatches[v] += pointMismatches[v];
+    }
+
+    cout << setw(10) << n << fixed << setprecision(1) << setw(11) << double(selected) / max(nEvents, size_t(1)) << setprecision(0);
+    for( size_t v = 0; v < nVariants; v++ ) cout << setw(20) << nsPerEvent[v];
+    cout << endl;
+    if ( csv.is_open() )
+      for( size_t v = 0; v < nVariants; v++ )
+	csv << n << "," << double(selected) / max(nEvents, size_t(1)) << ",\"" << variants[v].name << "\","
+	    << nsPerEvent[v] << "," << pointMismatches[v] << "\n";
+  }
+
+  bool identical = true;
+  for( size_t v = 1; v < nVariants; v++ ) {
+    if ( mismatches[v] == 0 ) continue;
+    cout << variants[v].name << ": " << mismatches[v] << " sums differ from the nested loop" << endl;
+    identical = false;
+  }
+  if ( identical ) cout << "all the variants give the sums of the nested loop" << endl;
+  return identical ? 0 : 1;
+}
@@ -1,10 +1,18 @@
 // ADHOCNTUPLER: Creates eventA in the cfA ntuples, the tree that requires
 //               Ad hoc c++ code to be filled.
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "FWCore/Framework/interface/ESHandle.h"
 #include "FWCore/Framework/interface/Run.h"
+#include "FWCore/MessageLogger/interface/MessageLogger.h"
 #include "FWCore/Utilities/interface/Exception.h"
 #include "FWCore/Common/interface/TriggerNames.h"
 
@@ -20,6 +28,7 @@
 #include "DataFormats/PatCandidates/interface/PackedTriggerPrescales.h"
 #include "DataFormats/PatCandidates/interface/TriggerObjectStandAlone.h"
 #include "DataFormats/L1GlobalTrigger/interface/L1GlobalTriggerReadoutRecord.h"
+#include "DataFormats/L1GlobalTrigger/interface/L1GtTriggerMenuLite.h"
 
 #include "DataFormats/Common/interface/TriggerResults.h"
 #include "DataFormats/Common/interface/ValueMap.h"
@@ -36,53 +45,62 @@
 #include <fastjet/ClusterSequence.hh>
 #include <fastjet/GhostedAreaSpec.hh>
 
+#include "CfANtupler/minicfa/interface/miniJobSummary.h"
+#include "CfANtupler/minicfa/interface/miniPFCandidateIndex.h"
+#include "CfANtupler/minicfa/interface/miniProfiler.h"
+#include "CfANtupler/minicfa/interface/miniStringDictionary.h"
+
 using namespace std;
 using namespace fastjet;
 
-class miniAdHocNTupler : public NTupler {
+class miniAdHocNTupler : public NTupler, public miniJobSummary {
  public:
 
   void fill(edm::Event& iEvent){
 
     nevents++;
+    profiler_.countEvent();
+    miniProfiler::Laps laps(&profiler_);
 
     //////////////// Fat jets //////////////////
     edm::Handle<pat::JetCollection> jets;
     iEvent.getByLabel("slimmedJets", jets);
 
-    JetDefinition jet_def_12(antikt_algorithm, 1.2);
-    //    vector<vector<PseudoJet>> fjets_vvector(0);
-    vector<PseudoJet> fjets_constituents(0), fjets(0);
-    vector<float> ptThresholds;
-    ptThresholds.push_back(30);
-    //const float etaThreshold(5);
-
-    for(unsigned int ipt(0); ipt < ptThresholds.size(); ipt++){
+    // The skinny jets as PseudoJets once for all the fat jet configurations, and their order in pt:
+    // the jets above a threshold are the first ones of this order, whatever the threshold
+    vector<PseudoJet> skinny_jets(0), fjets_constituents(0), fjets(0);
+    vector<unsigned int> jets_by_pt(jets->size()), fjets_inputs(0);
+    for (unsigned int ijet(0); ijet < jets->size(); ijet++) {
+      const pat::Jet &jet = (*jets)[ijet];
+      skinny_jets.push_back(PseudoJet(jet.px(),jet.py(),jet.pz(),jet.energy()));
+      jets_by_pt[ijet] = ijet;
+    }
+    stable_sort(jets_by_pt.begin(), jets_by_pt.end(), byDecreasingPt(*jets));
+
+    for(unsigned int iconf(0); iconf < fatJets_.size(); iconf++){
+      const FatJets &conf = fatJets_[iconf];
+      miniProfiler::Sentry sentry(&profiler_, conf.timer);
+      unsigned int npass(0);
+      while (npass < jets_by_pt.size() && !((*jets)[jets_by_pt[npass]].pt() < conf.ptThreshold)) npass++;
+      // The clustering input in the order of the jet collection, as it always was
+      fjets_inputs.assign(jets_by_pt.begin(), jets_by_pt.begin()+npass);
+      sort(fjets_inputs.begin(), fjets_inputs.end());
       fjets_constituents.resize(0);
-      //cout<<endl<<"SKINNY JETS"<<endl;
-      for (unsigned int ijet(0); ijet < jets->size(); ijet++) {
-	const pat::Jet &jet = (*jets)[ijet];
-	//if(fabs(jet.eta()) > etaThreshold) continue;
-	if(jet.pt() < ptThresholds[ipt]) continue;
-	fjets_constituents.push_back(PseudoJet(jet.px(),jet.py(),jet.pz(),jet.energy()));
-	//cout<<"pt "<<jet.pt()<<", eta "<<jet.eta()<<", phi "<<jet.phi()<<endl;
+      for (unsigned int i(0); i < fjets_inputs.size(); i++) {
+	if(fabs((*jets)[fjets_inputs[i]].eta()) > conf.maxEta) continue;
+	fjets_constituents.push_back(skinny_jets[fjets_inputs[i]]);
       }
-      ClusterSequence cs_fjets(fjets_constituents, jet_def_12);
+      ClusterSequence cs_fjets(fjets_constituents, fjets_constituents.size() > FatJets::maxN2Plain ? conf.tiled : conf.plain);
       fjets = sorted_by_pt(cs_fjets.inclusive_jets());
       for (unsigned int ifjet(0); ifjet < fjets.size(); ifjet++) {
-	fjets30_pt->push_back(fjets[ifjet].pt());
-	fjets30_eta->push_back(fjets[ifjet].eta());
-	fjets30_phi->push_back(fjets[ifjet].phi());
-	fjets30_energy->push_back(fjets[ifjet].E());
-	fjets30_m->push_back(fjets[ifjet].m());
+	conf.pt->push_back(fjets[ifjet].pt());
+	conf.eta->push_back(fjets[ifjet].eta());
+	conf.phi->push_back(fjets[ifjet].phi());
+	conf.energy->push_back(fjets[ifjet].E());
+	conf.m->push_back(fjets[ifjet].m());
       }
-
-//      cout<<endl<<"FAT JETS"<<endl;
-//      for (unsigned int ifjet(0); ifjet < fjets.size(); ifjet++) {
-//	cout<<"pt "<<fjets[ifjet].pt()<<", eta "<<fjets[ifjet].eta()<<", phi "<<fjets[ifjet].phi()<<endl;
-//      }
-//      fjets_vvector.push_back(fjets);
     }
+    laps.lap(fatJetsTimer_);
 
 
     //////////////// pfcands shenanigans //////////////////
@@ -95,24 +113,27 @@ class miniAdHocNTupler : public NTupler {
     edm::Handle<pat::TauCollection> taus;
     iEvent.getByLabel("slimmedTaus", taus);
 
-    vector<const pat::PackedCandidate*> el_pfmatch, mu_pfmatch; 
-    for (const pat::PackedCandidate &pfc : *pfcands) {
-      for (unsigned int ilep(0); ilep < electrons->size(); ilep++) {
-	const pat::Electron &lep = (*electrons)[ilep];
-	if(el_pfmatch.size() <= ilep) el_pfmatch.push_back(&pfc);
-	else if(lep.pdgId()==pfc.pdgId() && deltaR(pfc, lep) < deltaR(*(el_pfmatch[ilep]), lep)) el_pfmatch[ilep] = &pfc;
-      }
-      for (unsigned int ilep(0); ilep < muons->size(); ilep++) {
-	const pat::Muon &lep = (*muons)[ilep];
-	if(mu_pfmatch.size() <= ilep) mu_pfmatch.push_back(&pfc);
-	else if(lep.pdgId()==pfc.pdgId() && deltaR(pfc, lep) < deltaR(*(mu_pfmatch[ilep]), lep)) mu_pfmatch[ilep] = &pfc;
-      }
-    } // Loop over pfcands
+    // PF match of the leptons: the closest PFCandidate in dR with the pdgId of the lepton (starting
+    // from the first PFCandidate), searched in the PFCandidates of these pdgIds sorted in eta
+    set<int> lep_pdgIds;
+    for (const pat::Electron &lep : *electrons) lep_pdgIds.insert(lep.pdgId());
+    for (const pat::Muon &lep : *muons) lep_pdgIds.insert(lep.pdgId());
+    miniPFCandidateIndex pfcands_index(*pfcands, lep_pdgIds);
+    vector<const pat::PackedCandidate*> el_pfmatch, mu_pfmatch;
+    for (const pat::Electron &lep : *electrons) el_pfmatch.push_back(pfcands_index.bestMatch(lep));
+    for (const pat::Muon &lep : *muons) mu_pfmatch.push_back(pfcands_index.bestMatch(lep));
+
+    // Lepton of each matched PFCandidate, the first one if several have the same match
+    unordered_map<const pat::PackedCandidate*, int> el_of_pfc, mu_of_pfc;
+    for (unsigned int ilep(0); ilep < el_pfmatch.size(); ilep++)
+      if(el_pfmatch[ilep]) el_of_pfc.insert(make_pair(el_pfmatch[ilep], ilep));
+    for (unsigned int ilep(0); ilep < mu_pfmatch.size(); ilep++)
+      if(mu_pfmatch[ilep]) mu_of_pfc.insert(make_pair(mu_pfmatch[ilep], ilep));
 
     // Finding electron PF match
     for (unsigned int ilep(0); ilep < electrons->size(); ilep++) {
       const pat::Electron &lep = (*electrons)[ilep];
-      els_isPF->push_back(deltaR(lep, *el_pfmatch[ilep]) < 0.1 && abs(lep.p()-el_pfmatch[ilep]->p())/lep.p()<0.05 &&
+      els_isPF->push_back(el_pfmatch[ilep] && deltaR(lep, *el_pfmatch[ilep]) < 0.1 && abs(lep.p()-el_pfmatch[ilep]->p())/lep.p()<0.05 &&
 			  lep.pdgId() == el_pfmatch[ilep]->pdgId());
       els_jet_ind->push_back(-1);
     }
@@ -133,7 +154,7 @@ class miniAdHocNTupler : public NTupler {
       float maxp(-99.), maxp_mu(-99.), maxp_el(-99.);
       int maxid(0);
       for (unsigned int i = 0, n = jet.numberOfSourceCandidatePtrs(); i < n; ++i) {
-	const pat::PackedCandidate &pfc = dynamic_cast<const pat::PackedCandidate &>(*jet.sourceCandidatePtr(i));
+	const pat::PackedCandidate &pfc = packedCandidate(jet.sourceCandidatePtr(i), pfcands);
 	int pf_id = pfc.pdgId();
 	float pf_p = pfc.p();
 	if(pf_p > maxp){
@@ -142,29 +163,27 @@ class miniAdHocNTupler : public NTupler {
 	}
 
 	if(abs(pf_id) == 11){
-	  for (unsigned int ilep(0); ilep < electrons->size(); ilep++) {
-	    if(&pfc == el_pfmatch[ilep]){
-	      els_jet_ind->at(ilep) = ijet;
-	      if(pf_p > maxp_el){
-		maxp_el = pf_p;
-		jets_AK4_el_ind->at(ijet) = ilep; // Storing the index of the highest pt electron in jet
-	      }
-	      break;
+	  unordered_map<const pat::PackedCandidate*, int>::const_iterator lep = el_of_pfc.find(&pfc);
+	  if(lep != el_of_pfc.end()){
+	    int ilep = lep->second;
+	    els_jet_ind->at(ilep) = ijet;
+	    if(pf_p > maxp_el){
+	      maxp_el = pf_p;
+	      jets_AK4_el_ind->at(ijet) = ilep; // Storing the index of the highest pt electron in jet
 	    }
-	  } // Loop over electrons
+	  }
 	} // If pfc is an electron
 
 	if(abs(pf_id) == 13){
-	  for (unsigned int ilep(0); ilep < muons->size(); ilep++) {
-	    if(&pfc == mu_pfmatch[ilep]){
-	      mus_jet_ind->at(ilep) = ijet;
-	      if(pf_p > maxp_mu){
-		maxp_mu = pf_p;
-		jets_AK4_mu_ind->at(ijet) = ilep; // Storing the index of the highest pt muon in jet
-	      }
-	      break;
+	  unordered_map<const pat::PackedCandidate*, int>::const_iterator lep = mu_of_pfc.find(&pfc);
+	  if(lep != mu_of_pfc.end()){
+	    int ilep = lep->second;
+	    mus_jet_ind->at(ilep) = ijet;
+	    if(pf_p > maxp_mu){
+	      maxp_mu = pf_p;
+	      jets_AK4_mu_ind->at(ijet) = ilep; // Storing the index of the highest pt muon in jet
 	    }
-	  } // Loop over muons
+	  }
 	} // If pfc is an muon
 
       } // Loop over jet constituents
@@ -178,25 +197,18 @@ class miniAdHocNTupler : public NTupler {
       taus_el_ind->push_back(-1);
 
       if(tau.numberOfSourceCandidatePtrs() == 1){
-	const pat::PackedCandidate &pfc = dynamic_cast<const pat::PackedCandidate &> (*tau.sourceCandidatePtr(0));
+	const pat::PackedCandidate &pfc = packedCandidate(tau.sourceCandidatePtr(0), pfcands);
 	if(abs(pfc.pdgId())==11){
-	  for (unsigned int ilep(0); ilep < electrons->size(); ilep++) {
-	    if(&pfc == el_pfmatch[ilep]){
-	      taus_el_ind->at(itau) = ilep;
-	      break;
-	    } 
-	  } // Loop over electrons
+	  unordered_map<const pat::PackedCandidate*, int>::const_iterator lep = el_of_pfc.find(&pfc);
+	  if(lep != el_of_pfc.end()) taus_el_ind->at(itau) = lep->second;
 	}
 	if(abs(pfc.pdgId())==13){
-	  for (unsigned int ilep(0); ilep < muons->size(); ilep++) {
-	    if(&pfc == mu_pfmatch[ilep]){
-	      taus_mu_ind->at(itau) = ilep;
-	      break;
-	    } 
-	  } // Loop over electrons
+	  unordered_map<const pat::PackedCandidate*, int>::const_iterator lep = mu_of_pfc.find(&pfc);
+	  if(lep != mu_of_pfc.end()) taus_mu_ind->at(itau) = lep->second;
 	}
       } // If tau has one constituent
     } // Loop over taus
+    laps.lap(pfMatchingTimer_);
 
     //////////////// Pile up and generator information //////////////////
     double htEvent = 0.0;
@@ -237,58 +249,25 @@ class miniAdHocNTupler : public NTupler {
       }
       *genHT_ = htEvent;
     } // if it's not real data
+    laps.lap(pileupTimer_);
 
 
     //////////////// Filter decisions and names //////////////////
     edm::Handle<edm::TriggerResults> filterBits;
     edm::InputTag labfilterBits("TriggerResults","","PAT");
     iEvent.getByLabel(labfilterBits,filterBits);  
-    int trackingfailurefilterResult(1);			    
-    int goodVerticesfilterResult(1);				    
-    int cschalofilterResult(1);						    
-    int trkPOGfilterResult(1);						    
-    int trkPOG_logErrorTooManyClustersfilterResult(1);	
-    int EcalDeadCellTriggerPrimitivefilterResult(1);	
-    int ecallaserfilterResult(1);						    
-    int trkPOG_manystripclus53XfilterResult(1);		    
-    int eebadscfilterResult(1);						    
-    int METFiltersfilterResult(1);						    
-    int HBHENoisefilterResult(1);						    
-    int trkPOG_toomanystripclus53XfilterResult(1);		    
-    int hcallaserfilterResult(1);
-			               
+    // The MET filters are looked up by name once per menu of the PAT TriggerResults; 1 if absent
     const edm::TriggerNames &fnames = iEvent.triggerNames(*filterBits);
-    for (unsigned int i = 0, n = filterBits->size(); i < n; ++i) {
-      string filterName = fnames.triggerName(i);
-      int filterdecision = filterBits->accept(i);
-      if (filterName=="Flag_trackingFailureFilter")		 trackingfailurefilterResult = filterdecision;
-      if (filterName=="Flag_goodVertices")			 goodVerticesfilterResult = filterdecision;
-      if (filterName=="Flag_CSCTightHaloFilter")		 cschalofilterResult = filterdecision;
-      if (filterName=="Flag_trkPOGFilters")			 trkPOGfilterResult = filterdecision;
-      if (filterName=="Flag_trkPOG_logErrorTooManyClusters")	 trkPOG_logErrorTooManyClustersfilterResult = filterdecision;
-      if (filterName=="Flag_EcalDeadCellTriggerPrimitiveFilter") EcalDeadCellTriggerPrimitivefilterResult = filterdecision;
-      if (filterName=="Flag_ecalLaserCorrFilter")		 ecallaserfilterResult = filterdecision;
-      if (filterName=="Flag_trkPOG_manystripclus53X")		 trkPOG_manystripclus53XfilterResult = filterdecision;
-      if (filterName=="Flag_eeBadScFilter")			 eebadscfilterResult = filterdecision;
-      if (filterName=="Flag_METFilters")			 METFiltersfilterResult = filterdecision;
-      if (filterName=="Flag_HBHENoiseFilter")			 HBHENoisefilterResult = filterdecision;
-      if (filterName=="Flag_trkPOG_toomanystripclus53X")	 trkPOG_toomanystripclus53XfilterResult = filterdecision;
-      if (filterName=="Flag_hcalLaserEventFilter")		 hcallaserfilterResult = filterdecision;
+    if (fnames.parameterSetID() != filterNamesID_){
+      filterNamesID_ = fnames.parameterSetID();
+      for (unsigned int f = 0; f < filterNames_.size(); ++f) {
+	unsigned int i = fnames.triggerIndex(filterNames_[f]);
+	filterIndices_[f] = i < fnames.size() ? int(i) : -1;
+      }
     }
-
-    *trackingfailurefilter_decision_			=                trackingfailurefilterResult;	   
-    *goodVerticesfilter_decision_			=		    goodVerticesfilterResult;	   
-    *cschalofilter_decision_				=			    cschalofilterResult;   	    
-    *trkPOGfilter_decision_				=			    trkPOGfilterResult;	   
-    *trkPOG_logErrorTooManyClustersfilter_decision_	=  trkPOG_logErrorTooManyClustersfilterResult;  
-    *EcalDeadCellTriggerPrimitivefilter_decision_	=    EcalDeadCellTriggerPrimitivefilterResult;    
-    *ecallaserfilter_decision_				=			    ecallaserfilterResult; 	    
-    *trkPOG_manystripclus53Xfilter_decision_		=	    trkPOG_manystripclus53XfilterResult;   
-    *eebadscfilter_decision_				=			    eebadscfilterResult;   	    
-    *METFiltersfilter_decision_				=			    METFiltersfilterResult;	    
-    *HBHENoisefilter_decision_				=			    HBHENoisefilterResult; 	    
-    *trkPOG_toomanystripclus53Xfilter_decision_		=	    trkPOG_toomanystripclus53XfilterResult;
-    *hcallaserfilter_decision_				=                       hcallaserfilterResult;     
+    for (unsigned int f = 0; f < filterNames_.size(); ++f)
+      *filterDecisions_[f] = filterIndices_[f] < 0 ? 1 : filterBits->accept(filterIndices_[f]);
+    laps.lap(filtersTimer_);
 
     //////////////// Trigger decisions and names //////////////////
     edm::Handle<edm::TriggerResults> triggerBits;
@@ -300,45 +279,88 @@ class miniAdHocNTupler : public NTupler {
     edm::InputTag labtriggerPrescales("patTrigger");
     iEvent.getByLabel(labtriggerPrescales,triggerPrescales);  
 
+    // The names are in the triggerMenus tree, once per run and menu: the events have the key of their
+    // menu there, and the decisions packed in 64 bit words (path i is bit i%64 of word i/64)
     const edm::TriggerNames &names = iEvent.triggerNames(*triggerBits);
+    *trigger_menu_ = triggerMenu(names, iEvent.id().run());
+    (*trigger_bits_).assign((triggerBits->size()+63)/64, 0);
     for (unsigned int i = 0, n = triggerBits->size(); i < n; ++i) {
-      (*trigger_decision).push_back(triggerBits->accept(i));
-      (*trigger_name).push_back(names.triggerName(i));
+      if (triggerBits->accept(i)) (*trigger_bits_)[i/64] |= ULong64_t(1) << (i%64);
       (*trigger_prescalevalue).push_back(triggerPrescales->getPrescaleForIndex(i));
+      if (triggerNamesPerEvent_){
+	(*trigger_decision).push_back(triggerBits->accept(i));
+	(*trigger_name).push_back(names.triggerName(i));
+      }
     }
+    laps.lap(triggersTimer_);
    
     //////////////// HLT trigger objects //////////////////
     edm::Handle<pat::TriggerObjectStandAloneCollection> triggerObjects;
     edm::InputTag labtriggerObjects("selectedPatTrigger");
     iEvent.getByLabel(labtriggerObjects,triggerObjects);  
 
-    for (pat::TriggerObjectStandAlone obj : *triggerObjects) { // note: not "const &" since we want to call unpackPathNames
-      obj.unpackPathNames(names);
-      (*standalone_triggerobject_collectionname).push_back(obj.collection()); 
-      (*standalone_triggerobject_pt).push_back(obj.pt());
-      (*standalone_triggerobject_px).push_back(obj.px());
-      (*standalone_triggerobject_py).push_back(obj.py());
-      (*standalone_triggerobject_pz).push_back(obj.pz());
-      (*standalone_triggerobject_et).push_back(obj.et());
-      (*standalone_triggerobject_energy).push_back(obj.energy());
-      (*standalone_triggerobject_phi).push_back(obj.phi());
-      (*standalone_triggerobject_eta).push_back(obj.eta());
+    // The collections are indices in the triggerObjectCollections tree, and the paths of triggerObjectPaths
+    // the object fired are the bits of a mask. The paths of an object are packed in miniAOD: they are unpacked
+    // in a scratch object reused from one object to the next, and only if some paths are configured.
+    // The objects failing triggerObjectSelection are dropped before that
+    if ((!triggerObjectPaths_.empty() || !selectedPaths_.empty()) && names.parameterSetID()!=pathBitsID_) resolveTriggerObjectPaths(names);
+    for (pat::TriggerObjectStandAloneCollection::const_iterator obj = triggerObjects->begin(); obj != triggerObjects->end(); ++obj) {
+      bool unpacked = false;
+      if (!selectTriggerObject(*obj, names, unpacked)) {
+	++triggerObjectsDropped_;
+	continue;
+      }
+      ++triggerObjectsKept_;
+      (*standalone_triggerobject_collection).push_back(triggerObjectCollections_.index(iEvent.id().run(), obj->collection()));
+      if (triggerNamesPerEvent_) (*standalone_triggerobject_collectionname).push_back(obj->collection());
+      if (!triggerObjectPaths_.empty()){
+	if (!unpacked) unpackTriggerObject(*obj, names);
+	ULong64_t mask(0);
+	for (std::unordered_map<std::string, ULong64_t>::const_iterator bits = pathBits_.begin(); bits != pathBits_.end(); ++bits)
+	  if (triggerObjectScratch_.hasPathName(bits->first, true)) mask |= bits->second;
+	(*standalone_triggerobject_paths).push_back(mask);
+      }
+      (*standalone_triggerobject_pt).push_back(obj->pt());
+      (*standalone_triggerobject_px).push_back(obj->px());
+      (*standalone_triggerobject_py).push_back(obj->py());
+      (*standalone_triggerobject_pz).push_back(obj->pz());
+      (*standalone_triggerobject_et).push_back(obj->et());
+      (*standalone_triggerobject_energy).push_back(obj->energy());
+      (*standalone_triggerobject_phi).push_back(obj->phi());
+      (*standalone_triggerobject_eta).push_back(obj->eta());
     }
+    laps.lap(triggerObjectsTimer_);
 
-    //////////////// L1 trigger objects --- TO BE UNDERSTOOD ---
+    //////////////// L1 global trigger decision words //////////////////
+    // The algorithm bits in L1_algo_bits[2] (bit i is bit i%64 of word i/64), the technical ones in L1_tech_bits,
+    // their names in the l1TriggerMenus tree once per run. L1_decision is -1 without the readout record
+    if (iEvent.id().run() != l1MenuRun_) writeL1TriggerMenu(iEvent.getRun());
     edm::Handle<L1GlobalTriggerReadoutRecord> L1trigger_h;
     edm::InputTag labL1trigger("gtDigis","","HLT");
     iEvent.getByLabel(labL1trigger, L1trigger_h);  
-
-    std::vector<bool> gtbits;
-    int ngtbits = 128;
-    gtbits.reserve(ngtbits); for(int i=0; i<ngtbits; i++) gtbits[i]=false;
-    if(L1trigger_h.isValid()) 
-      gtbits = L1trigger_h->decisionWord();
-    for(int i=0; i<ngtbits; i++) if(gtbits[i]) cout<<"Bit "<<i<<" is true"<<endl;
-
-    const L1GlobalTriggerReadoutRecord* L1trigger = L1trigger_h.failedToGet () ? 0 : &*L1trigger_h;
-    if(L1trigger) cout<<"Level 1 decision: "<<L1trigger->decision()<<endl;
+    L1_algo_bits_[0] = L1_algo_bits_[1] = 0;
+    *L1_tech_bits_ = 0;
+    *L1_decision_ = -1;
+    if (L1trigger_h.isValid()) {
+      const DecisionWord &algoWord = L1trigger_h->decisionWord();
+      for (unsigned int i = 0, n = std::min(algoWord.size(), size_t(128)); i < n; ++i)
+	if (algoWord[i]) L1_algo_bits_[i/64] |= ULong64_t(1) << (i%64);
+      const TechnicalTriggerWord &techWord = L1trigger_h->technicalTriggerWord();
+      for (unsigned int i = 0, n = std::min(techWord.size(), size_t(64)); i < n; ++i)
+	if (techWord[i]) *L1_tech_bits_ |= ULong64_t(1) << i;
+      *L1_decision_ = L1trigger_h->decision();
+      LogDebug("miniAdHocNTuplerL1") << "L1 decision " << *L1_decision_ << ", algorithm bits " << std::hex
+				     << L1_algo_bits_[1] << " " << L1_algo_bits_[0] << ", technical bits " << *L1_tech_bits_;
+    } else {
+      // once per run: gtDigis is missing from every event of data miniAOD
+      ++l1RecordMissing_;
+      if (!l1RecordWarned_) {
+	l1RecordWarned_ = true;
+	edm::LogWarning("miniAdHocNTuplerL1") << "no L1GlobalTriggerReadoutRecord " << labL1trigger.encode() << " in run "
+					      << iEvent.id().run() << ": L1_decision is -1 (warned once per run)";
+      }
+    }
+    laps.lap(l1Timer_);
 
 
    //isolated pf candidates as found by TrackIsolationMaker                                                                               
@@ -363,18 +385,26 @@ class miniAdHocNTupler : public NTupler {
      isotk_dzpv_ -> push_back( pfcand_dzpv->at(it));
      isotk_charge_ -> push_back( pfcand_charge->at(it));
    }
+   laps.lap(isoTracksTimer_);
 
    // tauID
+    // the positions of the discriminators are checked on the first tau of the event, and resolved again
+    // if the names there changed; a tau with another layout is looked up by name
     for (unsigned int itau(0); itau < taus->size(); itau++) {
       const pat::Tau &tau = (*taus)[itau];
-      taus_byCombinedIsolationDeltaBetaCorrRaw3Hits_->push_back( tau.tauID("byCombinedIsolationDeltaBetaCorrRaw3Hits") );
-      taus_byLooseCombinedIsolationDeltaBetaCorr3Hits_->push_back( tau.tauID("byLooseCombinedIsolationDeltaBetaCorr3Hits") );
-      taus_byMediumCombinedIsolationDeltaBetaCorr3Hits_->push_back( tau.tauID("byMediumCombinedIsolationDeltaBetaCorr3Hits") );
-      taus_byTightCombinedIsolationDeltaBetaCorr3Hits_->push_back( tau.tauID("byTightCombinedIsolationDeltaBetaCorr3Hits") );
+      const std::vector<pat::Tau::IdPair> &ids = tau.tauIDs();
+      if (itau == 0 && !sameTauIDLayout(ids)) resolveTauIDs(ids);
+      bool resolved = ids.size() == tauIDsSize_;
+      for (unsigned int id(0); id < tauIDNames_.size(); id++) {
+	const pat::Tau::IdPair * pair = resolved ? &ids[tauIDIndices_[id]] : 0;
+	float value = (pair && pair->first == tauIDNames_[id]) ? pair->second : tau.tauID(tauIDNames_[id]);
+	if (tauIDFloats_[id]) tauIDFloats_[id]->push_back(value);
+	else tauIDBools_[id]->push_back(value);
+      }
       taus_n_pfcands_->push_back( tau.numberOfSourceCandidatePtrs() );
       taus_decayMode_->push_back( tau.pfEssential().decayMode_ );
     } // Loop over taus
-
+    laps.lap(tauIDsTimer_);
    
 
     //fill the tree    
@@ -382,6 +412,7 @@ class miniAdHocNTupler : public NTupler {
     (*trigger_name).clear();
     (*trigger_decision).clear();
     (*trigger_prescalevalue).clear();
+    (*trigger_bits_).clear();
     (*standalone_triggerobject_pt).clear();
     (*standalone_triggerobject_px).clear();
     (*standalone_triggerobject_py).clear();
@@ -391,6 +422,8 @@ class miniAdHocNTupler : public NTupler {
     (*standalone_triggerobject_phi).clear();
     (*standalone_triggerobject_eta).clear();
     (*standalone_triggerobject_collectionname).clear();
+    (*standalone_triggerobject_collection).clear();
+    (*standalone_triggerobject_paths).clear();
 
     (*PU_zpositions_).clear();
     (*PU_sumpT_lowpT_).clear();
@@ -419,20 +452,22 @@ class miniAdHocNTupler : public NTupler {
     (*isotk_dzpv_).clear();
     (*isotk_charge_).clear();
     
-    (*taus_byCombinedIsolationDeltaBetaCorrRaw3Hits_).clear();
-    (*taus_byLooseCombinedIsolationDeltaBetaCorr3Hits_).clear();
-    (*taus_byMediumCombinedIsolationDeltaBetaCorr3Hits_).clear();
-    (*taus_byTightCombinedIsolationDeltaBetaCorr3Hits_).clear();
+    for (unsigned int id(0); id < tauIDNames_.size(); id++) {
+      if (tauIDFloats_[id]) (*tauIDFloats_[id]).clear();
+      else (*tauIDBools_[id]).clear();
+    }
     (*taus_n_pfcands_).clear();
     (*taus_decayMode_).clear();
 
-    (*fjets30_pt).clear();
-    (*fjets30_eta).clear();
-    (*fjets30_phi).clear();
-    (*fjets30_energy).clear();
-    (*fjets30_m).clear();
-
+    for(unsigned int iconf(0); iconf < fatJets_.size(); iconf++){
+      (*fatJets_[iconf].pt).clear();
+      (*fatJets_[iconf].eta).clear();
+      (*fatJets_[iconf].phi).clear();
+      (*fatJets_[iconf].energy).clear();
+      (*fatJets_[iconf].m).clear();
+    }
 
+    laps.lap(treeFillTimer_);
 
   }
 
@@ -457,8 +492,12 @@ class miniAdHocNTupler : public NTupler {
       }
       
       //register the leaves by hand
-      tree_->Branch("trigger_decision",&trigger_decision);
-      tree_->Branch("trigger_name",&trigger_name);
+      tree_->Branch("trigger_menu",trigger_menu_,"trigger_menu/i");
+      tree_->Branch("trigger_bits",&trigger_bits_);
+      if (triggerNamesPerEvent_){
+	tree_->Branch("trigger_decision",&trigger_decision);
+	tree_->Branch("trigger_name",&trigger_name);
+      }
       tree_->Branch("trigger_prescalevalue",&trigger_prescalevalue);
       tree_->Branch("standalone_triggerobject_pt",&standalone_triggerobject_pt);
       tree_->Branch("standalone_triggerobject_px",&standalone_triggerobject_px);
@@ -468,7 +507,9 @@ class miniAdHocNTupler : public NTupler {
       tree_->Branch("standalone_triggerobject_energy",&standalone_triggerobject_energy);
       tree_->Branch("standalone_triggerobject_phi",&standalone_triggerobject_phi);
       tree_->Branch("standalone_triggerobject_eta",&standalone_triggerobject_eta);
-      tree_->Branch("standalone_triggerobject_collectionname",&standalone_triggerobject_collectionname);
+      tree_->Branch("standalone_triggerobject_collection",&standalone_triggerobject_collection);
+      if (triggerNamesPerEvent_) tree_->Branch("standalone_triggerobject_collectionname",&standalone_triggerobject_collectionname);
+      if (!triggerObjectPaths_.empty()) tree_->Branch("standalone_triggerobject_paths",&standalone_triggerobject_paths);
 
       tree_->Branch("PU_zpositions",&PU_zpositions_);
       tree_->Branch("PU_sumpT_lowpT",&PU_sumpT_lowpT_);
@@ -512,18 +553,42 @@ class miniAdHocNTupler : public NTupler {
       tree_->Branch("isotk_dzpv",&isotk_dzpv_);
       tree_->Branch("isotk_charge",&isotk_charge_);
 
-      tree_->Branch("taus_byCombinedIsolationDeltaBetaCorrRaw3Hits",&taus_byCombinedIsolationDeltaBetaCorrRaw3Hits_);
-      tree_->Branch("taus_byLooseCombinedIsolationDeltaBetaCorr3Hits",&taus_byLooseCombinedIsolationDeltaBetaCorr3Hits_);
-      tree_->Branch("taus_byMediumCombinedIsolationDeltaBetaCorr3Hits",&taus_byMediumCombinedIsolationDeltaBetaCorr3Hits_);
-      tree_->Branch("taus_byTightCombinedIsolationDeltaBetaCorr3Hits",&taus_byTightCombinedIsolationDeltaBetaCorr3Hits_);
+      for (unsigned int id(0); id < tauIDNames_.size(); id++) {
+	if (tauIDFloats_[id]) tree_->Branch(("taus_"+tauIDNames_[id]).c_str(), &tauIDFloats_[id]);
+	else tree_->Branch(("taus_"+tauIDNames_[id]).c_str(), &tauIDBools_[id]);
+      }
       tree_->Branch("taus_n_pfcands",&taus_n_pfcands_);
       tree_->Branch("taus_decayMode",&taus_decayMode_);
 
-      tree_->Branch("fjets30_pt", &fjets30_pt);  
-      tree_->Branch("fjets30_eta", &fjets30_eta);
-      tree_->Branch("fjets30_phi", &fjets30_phi);
-      tree_->Branch("fjets30_energy",&fjets30_energy);
-      tree_->Branch("fjets30_m",&fjets30_m);
+      for(unsigned int iconf(0); iconf < fatJets_.size(); iconf++){
+	FatJets &conf = fatJets_[iconf];
+	tree_->Branch((conf.name+"_pt").c_str(), &conf.pt);
+	tree_->Branch((conf.name+"_eta").c_str(), &conf.eta);
+	tree_->Branch((conf.name+"_phi").c_str(), &conf.phi);
+	tree_->Branch((conf.name+"_energy").c_str(), &conf.energy);
+	tree_->Branch((conf.name+"_m").c_str(), &conf.m);
+      }
+
+      //the HLT menus, one entry per run and menu
+      menuTree_=fs->make<TTree>("triggerMenus","HLT menus of the trigger_bits");
+      menuTree_->Branch("menu",&menuIndex_,"menu/i");
+      menuTree_->Branch("run",&menuRun_,"run/i");
+      menuTree_->Branch("psetID",&menuPSetID_);
+      menuTree_->Branch("trigger_name",&menuNames_);
+
+      tree_->Branch("L1_decision",L1_decision_,"L1_decision/I");
+      tree_->Branch("L1_algo_bits",L1_algo_bits_,"L1_algo_bits[2]/l");
+      tree_->Branch("L1_tech_bits",L1_tech_bits_,"L1_tech_bits/l");
+
+      //the names of the L1 bits, one entry per run
+      l1MenuTree_=fs->make<TTree>("l1TriggerMenus","L1 menus of the L1_algo_bits and L1_tech_bits");
+      l1MenuTree_->Branch("run",&l1MenuRun_,"run/i");
+      l1MenuTree_->Branch("menu",&l1MenuName_);
+      l1MenuTree_->Branch("algo_name",&l1AlgoNames_);
+      l1MenuTree_->Branch("tech_name",&l1TechNames_);
+
+      //the collections of the trigger objects, one entry per collection and run
+      triggerObjectCollections_.book(fs->make<TTree>("triggerObjectCollections","collections of the standalone_triggerobject_collection"));
 
 
     }
@@ -541,10 +606,28 @@ class miniAdHocNTupler : public NTupler {
     //clean up whatever memory was allocated
   }
 
-  miniAdHocNTupler (const edm::ParameterSet& iConfig){
+  void summarize(){
+    edm::LogVerbatim("miniAdHocNTupler")<<"trigger objects: "<<triggerObjectsKept_<<" kept, "<<triggerObjectsDropped_<<" dropped";
+    if (l1RecordMissing_!=0) edm::LogVerbatim("miniAdHocNTupler")<<"no L1GlobalTriggerReadoutRecord in "<<l1RecordMissing_<<" events";
+    profiler_.report();
+  }
+
+  miniAdHocNTupler (const edm::ParameterSet& iConfig) : profiler_("miniAdHocNTupler", iConfig) {
     edm::ParameterSet adHocPSet = iConfig.getParameter<edm::ParameterSet>("AdHocNPSet");
     nevents = 0;
 
+    //the blocks of fill(...), timed one after the other
+    fatJetsTimer_=profiler_.timer("fat jets");
+    pfMatchingTimer_=profiler_.timer("PF matching of leptons, jets and taus");
+    pileupTimer_=profiler_.timer("pile up and generator information");
+    filtersTimer_=profiler_.timer("filter decisions");
+    triggersTimer_=profiler_.timer("trigger decisions and prescales");
+    triggerObjectsTimer_=profiler_.timer("trigger objects");
+    l1Timer_=profiler_.timer("L1 trigger");
+    isoTracksTimer_=profiler_.timer("isolated tracks");
+    tauIDsTimer_=profiler_.timer("tau IDs");
+    treeFillTimer_=profiler_.timer("TTree::Fill and clean up");
+
     if (adHocPSet.exists("useTFileService"))
       useTFileService_=adHocPSet.getParameter<bool>("useTFileService");         
     else
@@ -565,6 +648,15 @@ class miniAdHocNTupler : public NTupler {
     trigger_decision = new std::vector<bool>;
     trigger_name = new std::vector<std::string>;
     trigger_prescalevalue = new std::vector<float>;
+    trigger_menu_ = new unsigned int;
+    trigger_bits_ = new std::vector<ULong64_t>;
+    menuTree_ = 0;
+    menuIndex_ = 0;
+    menuRun_ = 0;
+    menuPSetID_ = new std::string;
+    menuNames_ = new std::vector<std::string>;
+    //the per event names and decisions of all the paths, as before the triggerMenus tree
+    triggerNamesPerEvent_ = adHocPSet.exists("triggerNamesPerEvent") && adHocPSet.getParameter<bool>("triggerNamesPerEvent");
     standalone_triggerobject_pt = new std::vector<float>;
     standalone_triggerobject_px = new std::vector<float>;
     standalone_triggerobject_py = new std::vector<float>;
@@ -574,6 +666,35 @@ class miniAdHocNTupler : public NTupler {
     standalone_triggerobject_phi = new std::vector<float>;
     standalone_triggerobject_eta = new std::vector<float>;
     standalone_triggerobject_collectionname = new std::vector<std::string>;
+    standalone_triggerobject_collection = new std::vector<unsigned int>;
+    L1_decision_ = new int;
+    L1_algo_bits_ = new ULong64_t[2];
+    L1_tech_bits_ = new ULong64_t;
+    l1MenuTree_ = 0;
+    l1MenuRun_ = 0;
+    l1RecordWarned_ = false;
+    l1RecordMissing_ = 0;
+    l1MenuName_ = new std::string;
+    l1AlgoNames_ = new std::vector<std::string>;
+    l1TechNames_ = new std::vector<std::string>;
+    standalone_triggerobject_paths = new std::vector<ULong64_t>;
+    //the paths of the bits of standalone_triggerobject_paths, as prefixes of the path names (without the version)
+    if (adHocPSet.exists("triggerObjectPaths"))
+      triggerObjectPaths_ = adHocPSet.getParameter<std::vector<std::string> >("triggerObjectPaths");
+    if (triggerObjectPaths_.size() > 64)
+      throw cms::Exception("Configuration") << "miniAdHocNTupler: " << triggerObjectPaths_.size() << " triggerObjectPaths, 64 at most";
+    //the trigger objects kept: pt above minPt, and if any list is given, a path (prefix of the name), a filter
+    //label or a collection (prefix of the name, e.g. without the process) of the lists
+    triggerObjectMinPt_ = 0;
+    if (adHocPSet.exists("triggerObjectSelection")){
+      edm::ParameterSet selection = adHocPSet.getParameter<edm::ParameterSet>("triggerObjectSelection");
+      if (selection.exists("minPt")) triggerObjectMinPt_ = selection.getParameter<double>("minPt");
+      if (selection.exists("paths")) selectedPaths_ = selection.getParameter<std::vector<std::string> >("paths");
+      if (selection.exists("filters")) selectedFilters_ = selection.getParameter<std::vector<std::string> >("filters");
+      if (selection.exists("collections")) selectedCollections_ = selection.getParameter<std::vector<std::string> >("collections");
+    }
+    triggerObjectsKept_ = 0;
+    triggerObjectsDropped_ = 0;
 
     PU_zpositions_ = new std::vector<std::vector<float> >;
     PU_sumpT_lowpT_ = new std::vector<std::vector<float> >;
@@ -600,6 +721,18 @@ class miniAdHocNTupler : public NTupler {
     trkPOG_toomanystripclus53Xfilter_decision_		= new int;
     hcallaserfilter_decision_				= new int;
 
+    const char * filterNames[] = {"Flag_trackingFailureFilter", "Flag_goodVertices", "Flag_CSCTightHaloFilter",
+				  "Flag_trkPOGFilters", "Flag_trkPOG_logErrorTooManyClusters", "Flag_EcalDeadCellTriggerPrimitiveFilter",
+				  "Flag_ecalLaserCorrFilter", "Flag_trkPOG_manystripclus53X", "Flag_eeBadScFilter", "Flag_METFilters",
+				  "Flag_HBHENoiseFilter", "Flag_trkPOG_toomanystripclus53X", "Flag_hcalLaserEventFilter"};
+    int * filterDecisions[] = {trackingfailurefilter_decision_, goodVerticesfilter_decision_, cschalofilter_decision_,
+			       trkPOGfilter_decision_, trkPOG_logErrorTooManyClustersfilter_decision_, EcalDeadCellTriggerPrimitivefilter_decision_,
+			       ecallaserfilter_decision_, trkPOG_manystripclus53Xfilter_decision_, eebadscfilter_decision_, METFiltersfilter_decision_,
+			       HBHENoisefilter_decision_, trkPOG_toomanystripclus53Xfilter_decision_, hcallaserfilter_decision_};
+    filterNames_.assign(filterNames, filterNames+sizeof(filterNames)/sizeof(filterNames[0]));
+    filterDecisions_.assign(filterDecisions, filterDecisions+sizeof(filterDecisions)/sizeof(filterDecisions[0]));
+    filterIndices_.assign(filterNames_.size(), -1);
+
     els_isPF = new std::vector<bool>;
     mus_isPF = new std::vector<bool>;
 
@@ -619,18 +752,56 @@ class miniAdHocNTupler : public NTupler {
     isotk_dzpv_ = new std::vector<float>;
     isotk_charge_ = new std::vector<int>;
 
-    taus_byCombinedIsolationDeltaBetaCorrRaw3Hits_ = new std::vector<bool>;
-    taus_byLooseCombinedIsolationDeltaBetaCorr3Hits_ = new std::vector<bool>;
-    taus_byMediumCombinedIsolationDeltaBetaCorr3Hits_ = new std::vector<bool>;
-    taus_byTightCombinedIsolationDeltaBetaCorr3Hits_ = new std::vector<bool>;
+    //the tau discriminators, taus_<name>: vector<bool>, or vector<float> with the suffix ":F" ("name:F")
+    std::vector<std::string> tauIDs;
+    if (adHocPSet.exists("tauIDs")) tauIDs = adHocPSet.getParameter<std::vector<std::string> >("tauIDs");
+    else{
+      tauIDs.push_back("byCombinedIsolationDeltaBetaCorrRaw3Hits");
+      tauIDs.push_back("byLooseCombinedIsolationDeltaBetaCorr3Hits");
+      tauIDs.push_back("byMediumCombinedIsolationDeltaBetaCorr3Hits");
+      tauIDs.push_back("byTightCombinedIsolationDeltaBetaCorr3Hits");
+    }
+    for (unsigned int id(0); id < tauIDs.size(); id++){
+      std::string name = tauIDs[id];
+      char type = 'O';
+      if (name.size() > 2 && name[name.size()-2] == ':'){
+	type = name[name.size()-1];
+	name.erase(name.size()-2);
+      }
+      if (type != 'O' && type != 'F')
+	throw cms::Exception("Configuration") << "miniAdHocNTupler: tau ID " << tauIDs[id] << ": the type is O (bool, the default) or F (float)";
+      tauIDNames_.push_back(name);
+      tauIDBools_.push_back(type == 'O' ? new std::vector<bool> : 0);
+      tauIDFloats_.push_back(type == 'F' ? new std::vector<float> : 0);
+    }
+    tauIDIndices_.assign(tauIDNames_.size(), 0);
+    tauIDsSize_ = std::numeric_limits<size_t>::max();
     taus_n_pfcands_ = new std::vector<int>;
     taus_decayMode_ = new std::vector<int>;
   
-    fjets30_pt =     new std::vector<float>;
-    fjets30_eta =    new std::vector<float>;
-    fjets30_phi =    new std::vector<float>;
-    fjets30_energy = new std::vector<float>;
-    fjets30_m =     new std::vector<float>;
+    // Fat jets: by default, anti-kt R=1.2 of the skinny jets above 30 GeV
+    std::vector<edm::ParameterSet> fatJetPSets;
+    if (adHocPSet.exists("fatJets"))
+      fatJetPSets=adHocPSet.getParameter<std::vector<edm::ParameterSet> >("fatJets");
+    else{
+      fatJetPSets.push_back(edm::ParameterSet());
+      fatJetPSets.back().addParameter<std::string>("name", "fjets30");
+      fatJetPSets.back().addParameter<double>("R", 1.2);
+      fatJetPSets.back().addParameter<double>("ptThreshold", 30.);
+    }
+    for (unsigned int iconf=0; iconf<fatJetPSets.size(); ++iconf){
+      const edm::ParameterSet & pset=fatJetPSets[iconf];
+      std::string name=pset.getParameter<std::string>("name");
+      fatJets_.push_back(FatJets(name, pset.getParameter<double>("R"), pset.getParameter<double>("ptThreshold"),
+				 pset.exists("algorithm") ? pset.getParameter<std::string>("algorithm") : std::string("antikt"),
+				 pset.exists("maxEta") ? pset.getParameter<double>("maxEta") : std::numeric_limits<double>::max()));
+      fatJets_.back().timer=profiler_.timer("fat jets "+name);
+      fatJets_.back().pt = new std::vector<float>;
+      fatJets_.back().eta = new std::vector<float>;
+      fatJets_.back().phi = new std::vector<float>;
+      fatJets_.back().energy = new std::vector<float>;
+      fatJets_.back().m = new std::vector<float>;
+    }
 
   }
 
@@ -638,6 +809,10 @@ class miniAdHocNTupler : public NTupler {
     delete trigger_decision;
     delete trigger_name;
     delete trigger_prescalevalue;
+    delete trigger_menu_;
+    delete trigger_bits_;
+    delete menuPSetID_;
+    delete menuNames_;
     delete standalone_triggerobject_pt;
     delete standalone_triggerobject_px;
     delete standalone_triggerobject_py;
@@ -647,6 +822,14 @@ class miniAdHocNTupler : public NTupler {
     delete standalone_triggerobject_phi;
     delete standalone_triggerobject_eta;
     delete standalone_triggerobject_collectionname;
+    delete standalone_triggerobject_collection;
+    delete L1_decision_;
+    delete [] L1_algo_bits_;
+    delete L1_tech_bits_;
+    delete l1MenuName_;
+    delete l1AlgoNames_;
+    delete l1TechNames_;
+    delete standalone_triggerobject_paths;
 
     delete PU_zpositions_;
     delete PU_sumpT_lowpT_;
@@ -691,31 +874,169 @@ class miniAdHocNTupler : public NTupler {
     delete isotk_dzpv_;
     delete isotk_charge_;
 
-    delete taus_byCombinedIsolationDeltaBetaCorrRaw3Hits_;
-    delete taus_byLooseCombinedIsolationDeltaBetaCorr3Hits_;
-    delete taus_byMediumCombinedIsolationDeltaBetaCorr3Hits_;
-    delete taus_byTightCombinedIsolationDeltaBetaCorr3Hits_;
+    for (unsigned int id(0); id < tauIDNames_.size(); id++) {
+      delete tauIDBools_[id];
+      delete tauIDFloats_[id];
+    }
     delete taus_n_pfcands_;
     delete taus_decayMode_;
   
-    delete fjets30_pt;
-    delete fjets30_eta;
-    delete fjets30_phi;
-    delete fjets30_energy;
-    delete fjets30_m;
+    for(unsigned int iconf(0); iconf < fatJets_.size(); iconf++){
+      delete fatJets_[iconf].pt;
+      delete fatJets_[iconf].eta;
+      delete fatJets_[iconf].phi;
+      delete fatJets_[iconf].energy;
+      delete fatJets_[iconf].m;
+    }
 
   }
 
  private:
+  //the key of the menu of names: a hash of its ParameterSetID, the same in every job so that merged outputs
+  //join on (run, trigger_menu). The menu is written to the triggerMenus tree once per run it is met in
+  unsigned int triggerMenu(const edm::TriggerNames & names, unsigned int run){
+    std::map<edm::ParameterSetID, unsigned int>::const_iterator menu=triggerMenus_.find(names.parameterSetID());
+    if (menu==triggerMenus_.end()){
+      std::ostringstream psetID;
+      psetID<<names.parameterSetID();
+      unsigned int key=miniStringDictionary::hash(psetID.str());
+      for (std::map<edm::ParameterSetID, unsigned int>::const_iterator other=triggerMenus_.begin(); other!=triggerMenus_.end(); ++other)
+	if (other->second==key)
+	  throw cms::Exception("LogicError") << "miniAdHocNTupler: the HLT menus " << psetID.str() << " and " << other->first
+					     << " have the same trigger_menu " << key;
+      menu=triggerMenus_.insert(std::make_pair(names.parameterSetID(), key)).first;
+    }
+    if (menuTree_ && menuRuns_.insert(std::make_pair(run, menu->second)).second){
+      std::ostringstream psetID;
+      psetID<<names.parameterSetID();
+      menuIndex_=menu->second;
+      menuRun_=run;
+      *menuPSetID_=psetID.str();
+      *menuNames_=names.triggerNames();
+      menuTree_->Fill();
+    }
+    return menu->second;
+  }
+
+  //the names of the L1 bits of run, from its L1GtTriggerMenuLite ("" for the unused bits), to the l1TriggerMenus tree
+  void writeL1TriggerMenu(const edm::Run & run){
+    l1MenuRun_=run.run();
+    l1RecordWarned_=false;
+    l1MenuName_->clear();
+    l1AlgoNames_->assign(128, "");
+    l1TechNames_->assign(64, "");
+    edm::Handle<L1GtTriggerMenuLite> menu;
+    run.getByLabel("l1GtTriggerMenuLite", menu);
+    if (menu.isValid()){
+      *l1MenuName_=menu->gtTriggerMenuName();
+      for (L1GtTriggerMenuLite::CItL1Trig bit=menu->gtAlgorithmMap().begin(); bit!=menu->gtAlgorithmMap().end(); ++bit)
+	if (bit->first < l1AlgoNames_->size()) (*l1AlgoNames_)[bit->first]=bit->second;
+      for (L1GtTriggerMenuLite::CItL1Trig bit=menu->gtTechnicalTriggerMap().begin(); bit!=menu->gtTechnicalTriggerMap().end(); ++bit)
+	if (bit->first < l1TechNames_->size()) (*l1TechNames_)[bit->first]=bit->second;
+    } else {
+      edm::LogWarning("miniAdHocNTuplerL1") << "no L1GtTriggerMenuLite in run " << l1MenuRun_ << ": the L1 bits have no names";
+    }
+    if (l1MenuTree_) l1MenuTree_->Fill();
+  }
+
+  //the bits of the paths of the menu names in standalone_triggerobject_paths, and its paths selected
+  void resolveTriggerObjectPaths(const edm::TriggerNames & names){
+    pathBitsID_=names.parameterSetID();
+    pathBits_.clear();
+    selectedPathNames_.clear();
+    for (unsigned int i = 0; i < names.size(); ++i){
+      const std::string & name=names.triggerName(i);
+      for (unsigned int bit = 0; bit < triggerObjectPaths_.size(); ++bit)
+	if (name.compare(0, triggerObjectPaths_[bit].size(), triggerObjectPaths_[bit]) == 0) pathBits_[name] |= ULong64_t(1) << bit;
+      for (unsigned int p = 0; p < selectedPaths_.size(); ++p)
+	if (name.compare(0, selectedPaths_[p].size(), selectedPaths_[p]) == 0) selectedPathNames_.insert(name);
+    }
+  }
+
+  //obj with its path names unpacked, in triggerObjectScratch_. The paths are packed as indices in miniAOD,
+  //with no accessor to them in this release: the object is copied (into the buffers of the previous one)
+  //to unpack them, and the paths are then looked up in place with hasPathName
+  void unpackTriggerObject(const pat::TriggerObjectStandAlone & obj, const edm::TriggerNames & names){
+    triggerObjectScratch_ = obj;
+    triggerObjectScratch_.unpackPathNames(names);
+  }
+
+  //whether obj passes triggerObjectSelection. The paths, which need the object unpacked, are only
+  //tried if the pt, the collections and the filters did not decide; unpacked tells if they were
+  bool selectTriggerObject(const pat::TriggerObjectStandAlone & obj, const edm::TriggerNames & names, bool & unpacked){
+    unpacked=false;
+    if (obj.pt() < triggerObjectMinPt_) return false;
+    if (selectedPaths_.empty() && selectedFilters_.empty() && selectedCollections_.empty()) return true;
+    for (unsigned int c = 0; c < selectedCollections_.size(); ++c)
+      if (obj.collection().compare(0, selectedCollections_[c].size(), selectedCollections_[c]) == 0) return true;
+    for (unsigned int f = 0; f < selectedFilters_.size(); ++f)
+      if (obj.hasFilterLabel(selectedFilters_[f])) return true;
+    if (selectedPaths_.empty()) return false;
+    unpackTriggerObject(obj, names);
+    unpacked=true;
+    for (std::unordered_set<std::string>::const_iterator path = selectedPathNames_.begin(); path != selectedPathNames_.end(); ++path)
+      if (triggerObjectScratch_.hasPathName(*path, true)) return true;
+    return false;
+  }
+
+  //whether the tau discriminators are still at tauIDIndices_ in ids
+  bool sameTauIDLayout(const std::vector<pat::Tau::IdPair> & ids) const {
+    if (ids.size()!=tauIDsSize_) return false;
+    for (unsigned int id(0); id < tauIDNames_.size(); id++)
+      if (ids[tauIDIndices_[id]].first!=tauIDNames_[id]) return false;
+    return true;
+  }
+
+  //the positions of the tau discriminators in ids
+  void resolveTauIDs(const std::vector<pat::Tau::IdPair> & ids){
+    for (unsigned int id(0); id < tauIDNames_.size(); id++){
+      unsigned int i(0);
+      while (i < ids.size() && ids[i].first!=tauIDNames_[id]) i++;
+      if (i == ids.size())
+	throw cms::Exception("Configuration") << "miniAdHocNTupler: tau ID " << tauIDNames_[id] << " is not in slimmedTaus";
+      tauIDIndices_[id]=i;
+    }
+    tauIDsSize_=ids.size();
+  }
+
+  //the PackedCandidate of a constituent: by key if it is in packedPFCandidates, the general cast otherwise
+  static const pat::PackedCandidate & packedCandidate(const reco::CandidatePtr & ptr,
+						      const edm::Handle<pat::PackedCandidateCollection> & pfcands){
+    if(ptr.id() == pfcands.id() && ptr.key() < pfcands->size()) return (*pfcands)[ptr.key()];
+    return dynamic_cast<const pat::PackedCandidate &>(*ptr);
+  }
+
   bool ownTheTree_;
   std::string treeName_;
   bool useTFileService_;
   long nevents;
 
+  miniProfiler profiler_;
+  uint fatJetsTimer_, pfMatchingTimer_, pileupTimer_, filtersTimer_, triggersTimer_, triggerObjectsTimer_;
+  uint l1Timer_, isoTracksTimer_, tauIDsTimer_, treeFillTimer_;
+
 
   std::vector<bool> * trigger_decision;
   std::vector<std::string> * trigger_name;
   std::vector<float> * trigger_prescalevalue;
+  unsigned int * trigger_menu_;
+  std::vector<ULong64_t> * trigger_bits_;
+  bool triggerNamesPerEvent_;
+
+  //the HLT menus met so far, by ParameterSetID of their TriggerNames, and the triggerMenus tree
+  std::map<edm::ParameterSetID, unsigned int> triggerMenus_;
+  //the (run, trigger_menu) already in the triggerMenus tree
+  std::set<std::pair<unsigned int, unsigned int> > menuRuns_;
+  TTree * menuTree_;
+  unsigned int menuIndex_, menuRun_;
+  std::string * menuPSetID_;
+  std::vector<std::string> * menuNames_;
+
+  //the MET filters of the PAT TriggerResults, their decision and their index in the menu filterNamesID_
+  std::vector<std::string> filterNames_;
+  std::vector<int*> filterDecisions_;
+  std::vector<int> filterIndices_;
+  edm::ParameterSetID filterNamesID_;
   std::vector<float> * standalone_triggerobject_pt;
   std::vector<float> * standalone_triggerobject_px;
   std::vector<float> * standalone_triggerobject_py;
@@ -725,6 +1046,32 @@ class miniAdHocNTupler : public NTupler {
   std::vector<float> * standalone_triggerobject_phi;
   std::vector<float> * standalone_triggerobject_eta;
   std::vector<std::string> * standalone_triggerobject_collectionname;
+  std::vector<unsigned int> * standalone_triggerobject_collection;
+  std::vector<ULong64_t> * standalone_triggerobject_paths;
+  miniStringDictionary triggerObjectCollections_;
+
+  int * L1_decision_;
+  ULong64_t * L1_algo_bits_;
+  ULong64_t * L1_tech_bits_;
+  //the l1TriggerMenus tree, and the run of its last entry
+  TTree * l1MenuTree_;
+  unsigned int l1MenuRun_;
+  //the missing readout record is warned about once per run, and counted
+  bool l1RecordWarned_;
+  unsigned long l1RecordMissing_;
+  std::string * l1MenuName_;
+  std::vector<std::string> * l1AlgoNames_;
+  std::vector<std::string> * l1TechNames_;
+  std::vector<std::string> triggerObjectPaths_;
+  //the bits of the paths of the menu pathBitsID_ that match triggerObjectPaths_
+  std::unordered_map<std::string, ULong64_t> pathBits_;
+  edm::ParameterSetID pathBitsID_;
+  pat::TriggerObjectStandAlone triggerObjectScratch_;
+  //triggerObjectSelection, and the paths of the menu pathBitsID_ it selects
+  double triggerObjectMinPt_;
+  std::vector<std::string> selectedPaths_, selectedFilters_, selectedCollections_;
+  std::unordered_set<std::string> selectedPathNames_;
+  unsigned long triggerObjectsKept_, triggerObjectsDropped_;
 
   std::vector<std::vector<float> > * PU_zpositions_;
   std::vector<std::vector<float> > * PU_sumpT_lowpT_;
@@ -770,18 +1117,49 @@ class miniAdHocNTupler : public NTupler {
   std::vector<float> * isotk_dzpv_;
   std::vector<int> *   isotk_charge_;
 
-  std::vector<bool> *  taus_byCombinedIsolationDeltaBetaCorrRaw3Hits_;
-  std::vector<bool> *  taus_byLooseCombinedIsolationDeltaBetaCorr3Hits_;
-  std::vector<bool> *  taus_byMediumCombinedIsolationDeltaBetaCorr3Hits_;
-  std::vector<bool> *  taus_byTightCombinedIsolationDeltaBetaCorr3Hits_;
+  //the tau discriminators (in tauIDBools_ or tauIDFloats_, the other 0), and their positions in the tauIDs
+  //of taus with tauIDsSize_ of them
+  std::vector<std::string> tauIDNames_;
+  std::vector<std::vector<bool> *> tauIDBools_;
+  std::vector<std::vector<float> *> tauIDFloats_;
+  std::vector<unsigned int> tauIDIndices_;
+  size_t tauIDsSize_;
   std::vector<int> *  taus_n_pfcands_;
   std::vector<int> *  taus_decayMode_;
  
-  std::vector<float> * fjets30_pt;
-  std::vector<float> * fjets30_eta;
-  std::vector<float> * fjets30_phi;
-  std::vector<float> * fjets30_energy;
-  std::vector<float> * fjets30_m;
+  //a fat jet configuration: <name>_pt, ... of the jets clustered with R from the skinny jets above
+  //ptThreshold and within maxEta. Both strategies of FastJet give the same jets: N2Plain is the
+  //faster one for few inputs, N2Tiled for more
+  struct FatJets {
+    static const unsigned int maxN2Plain = 30;
+    FatJets(const std::string & n, double R, double pt, const std::string & algorithm, double eta) :
+      name(n), ptThreshold(pt), maxEta(eta),
+      plain(jetAlgorithm(algorithm), R, fastjet::E_scheme, fastjet::N2Plain),
+      tiled(jetAlgorithm(algorithm), R, fastjet::E_scheme, fastjet::N2Tiled),
+      timer(0), pt(0), eta(0), phi(0), energy(0), m(0) {}
+    static fastjet::JetAlgorithm jetAlgorithm(const std::string & algorithm){
+      if (algorithm=="antikt") return fastjet::antikt_algorithm;
+      if (algorithm=="kt") return fastjet::kt_algorithm;
+      if (algorithm=="cambridge") return fastjet::cambridge_algorithm;
+      throw cms::Exception("Configuration")<<"miniAdHocNTupler: unknown fat jet algorithm "<<algorithm<<" (antikt, kt or cambridge)";
+    }
+    std::string name;
+    double ptThreshold, maxEta;
+    fastjet::JetDefinition plain, tiled;
+    uint timer;
+    std::vector<float> * pt;
+    std::vector<float> * eta;
+    std::vector<float> * phi;
+    std::vector<float> * energy;
+    std::vector<float> * m;
+  };
+  std::vector<FatJets> fatJets_;
+
+  struct byDecreasingPt {
+    byDecreasingPt(const pat::JetCollection & jets) : jets_(jets) {}
+    bool operator()(unsigned int a, unsigned int b) const { return jets_[a].pt()>jets_[b].pt();}
+    const pat::JetCollection & jets_;
+  };
 
 
 };
@@ -0,0 +1,39 @@
+#ifndef miniCompiledLeaves_H
+#define miniCompiledLeaves_H
+
+// MINICOMPILEDLEAVES: leaf expressions of branchesPSet compiled into direct member function calls.
+//                     The plugins are written by minicfa/scripts/generateCompiledLeaves.py, and
+//                     miniStringBasedNTupler falls back to the string evaluator for any leaf not found here.
+
+#include "FWCore/PluginManager/interface/PluginFactory.h"
+
+#include <map>
+#include <string>
+
+//fills value and returns true, or returns false when the object has no value for the expression (null reference),
+//which is stored as the default value like a failed string evaluation
+typedef bool (*miniCompiledAccessor)(const void * object, double & value);
+
+class miniCompiledLeaves {
+ public:
+  virtual ~miniCompiledLeaves(){}
+
+  //the accessor compiled for the expression on className, 0 if it was not compiled
+  miniCompiledAccessor find(const std::string & className, const std::string & expr) const {
+    std::map<std::string, miniCompiledAccessor>::const_iterator a=accessors_.find(className+"::"+expr);
+    return (a==accessors_.end()) ? 0 : a->second;
+  }
+  unsigned int size() const { return accessors_.size();}
+
+ protected:
+  void add(const std::string & className, const std::string & expr, miniCompiledAccessor accessor){
+    accessors_[className+"::"+expr]=accessor;
+  }
+
+ private:
+  std::map<std::string, miniCompiledAccessor> accessors_;
+};
+
+typedef edmplugin::PluginFactory<miniCompiledLeaves*()> miniCompiledLeavesFactory;
+
+#endif
@@ -3,8 +3,9 @@
 #include "CfANtupler/minicfa/interface/miniStringBasedNTupler.h"
 #include "CfANtupler/minicfa/interface/miniVariableNTupler.h"
 #include "CfANtupler/minicfa/interface/miniAdHocNTupler.h"
+#include "CfANtupler/minicfa/interface/miniJobSummary.h"
 
-class miniCompleteNTupler : public NTupler {
+class miniCompleteNTupler : public NTupler, public miniJobSummary {
  public:
   miniCompleteNTupler(const edm::ParameterSet& iConfig){
     sN = new miniStringBasedNTupler(iConfig);
@@ -45,6 +46,14 @@ class miniCompleteNTupler : public NTupler {
       aN->callBack();
   }
 
+  void summarize(){
+    sN->summarize();
+    if (vN)
+      vN->summarize();
+    if (aN)
+      aN->summarize();
+  }
+
  private:
   miniStringBasedNTupler * sN;
   miniVariableNTupler * vN;  
@@ -0,0 +1,11 @@
+#ifndef miniJobSummary_H
+#define miniJobSummary_H
+
+//ntuplers with a report to print at the end of the job, from minicfa::endJob
+class miniJobSummary {
+ public:
+  virtual ~miniJobSummary(){}
+  virtual void summarize()=0;
+};
+
+#endif
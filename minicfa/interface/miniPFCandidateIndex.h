@@ -0,0 +1,74 @@
+#ifndef miniPFCandidateIndex_H
+#define miniPFCandidateIndex_H
+
+// MINIPFCANDIDATEINDEX: the PFCandidates of some pdgIds, sorted in eta once per event, to find the PF
+//                       match of a lepton without looping over all the PFCandidates. The match is the
+//                       one of the original loop: starting from the first PFCandidate (of any pdgId),
+//                       the closest in dR of the same pdgId as the lepton, the first in the collection
+//                       if several are at the same dR.
+
+#include "DataFormats/Math/interface/deltaR.h"
+#include "DataFormats/PatCandidates/interface/PackedCandidate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+
+class miniPFCandidateIndex {
+ public:
+  miniPFCandidateIndex(const pat::PackedCandidateCollection & pfcands, const std::set<int> & pdgIds) : pfcands_(pfcands) {
+    for (std::set<int>::const_iterator id=pdgIds.begin(); id!=pdgIds.end(); ++id) byPdgId_[*id];
+    for (uint i=0;i!=pfcands.size();++i){
+      std::map<int, std::vector<Entry> >::iterator list=byPdgId_.find(pfcands[i].pdgId());
+      if (list==byPdgId_.end()) continue;
+      Entry entry={pfcands[i].eta(), i};
+      //a nan eta is never the closest, and would break the sorting
+      if (entry.eta==entry.eta) list->second.push_back(entry);
+    }
+    for (std::map<int, std::vector<Entry> >::iterator list=byPdgId_.begin(); list!=byPdgId_.end(); ++list)
+      std::sort(list->second.begin(), list->second.end());
+  }
+
+  //the PF match of lep (pdgId among those of the index), 0 if there are no PFCandidates
+  template <class Lepton>
+  const pat::PackedCandidate * bestMatch(const Lepton & lep) const {
+    if (pfcands_.empty()) return 0;
+    uint best=0;
+    double bestDR=deltaR(pfcands_[0], lep);
+    std::map<int, std::vector<Entry> >::const_iterator list=byPdgId_.find(lep.pdgId());
+    if (list==byPdgId_.end()) return &pfcands_[best];
+
+    //the PFCandidates in increasing |deta| from the lepton, until |deta| alone is larger than the
+    //best dR (with a margin for the rounding of dR)
+    const std::vector<Entry> & candidates=list->second;
+    const double eta=lep.eta();
+    Entry key={eta, 0};
+    uint up=std::lower_bound(candidates.begin(), candidates.end(), key)-candidates.begin(), down=up;
+    while (up<candidates.size() || down>0){
+      bool takeUp=up<candidates.size() && (down==0 || candidates[up].eta-eta <= eta-candidates[down-1].eta);
+      const Entry & entry=takeUp ? candidates[up++] : candidates[--down];
+      if (std::fabs(entry.eta-eta) > bestDR+1e-9) break;
+      if (entry.index==0) continue; //the starting point
+      double dR=deltaR(pfcands_[entry.index], lep);
+      if (dR<bestDR || (dR==bestDR && entry.index<best)){
+	best=entry.index;
+	bestDR=dR;
+      }
+    }
+    return &pfcands_[best];
+  }
+
+ private:
+  struct Entry {
+    double eta;
+    uint index;
+    bool operator<(const Entry & other) const { return eta<other.eta || (eta==other.eta && index<other.index);}
+  };
+
+  const pat::PackedCandidateCollection & pfcands_;
+  std::map<int, std::vector<Entry> > byPdgId_;
+};
+
+#endif
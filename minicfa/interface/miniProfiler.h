@@ -0,0 +1,149 @@
+#ifndef miniProfiler_H
+#define miniProfiler_H
+
+// MINIPROFILER: wall time and number of calls of the parts of an ntupler (leaves, collections, variables,
+//               blocks of code), enabled with profile = cms.untracked.bool(True) in the Ntupler PSet.
+//               The table is printed at the end of the job, sorted by time, and optionally written as
+//               a TTree (profileTree) in the TFileService file and as a csv file (profileCSV).
+//               When disabled, a timed part costs a test of a null pointer.
+
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/MessageLogger/interface/MessageLogger.h"
+#include "FWCore/ServiceRegistry/interface/Service.h"
+#include "CommonTools/UtilAlgos/interface/TFileService.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+class miniProfiler {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  miniProfiler(const std::string & name, const edm::ParameterSet & iConfig) : name_(name), events_(0) {
+    enabled_=iConfig.getUntrackedParameter<bool>("profile",false);
+    writeTree_=iConfig.getUntrackedParameter<bool>("profileTree",false);
+    csv_=iConfig.getUntrackedParameter<std::string>("profileCSV","");
+  }
+
+  bool enabled() const { return enabled_;}
+
+  //index of the timer of a part, to be created before the first event
+  uint timer(const std::string & name){
+    names_.push_back(name);
+    times_.push_back(clock::duration::zero());
+    calls_.push_back(0);
+    return names_.size()-1;
+  }
+
+  void add(uint timer, clock::duration time) const {
+    times_[timer]+=time;
+    ++calls_[timer];
+  }
+  void countEvent() const { ++events_;}
+
+  //times its scope. Does nothing with a null or disabled profiler
+  class Sentry {
+   public:
+    Sentry(const miniProfiler * profiler, uint timer) :
+      profiler_((profiler && profiler->enabled()) ? profiler : 0), timer_(timer) {
+      if (profiler_) start_=clock::now();
+    }
+    ~Sentry(){ if (profiler_) profiler_->add(timer_, clock::now()-start_);}
+   private:
+    const miniProfiler * profiler_;
+    uint timer_;
+    clock::time_point start_;
+  };
+
+  //times consecutive blocks of code: lap(timer) charges the time since the previous lap to timer
+  class Laps {
+   public:
+    Laps(const miniProfiler * profiler) : profiler_((profiler && profiler->enabled()) ? profiler : 0) {
+      if (profiler_) last_=clock::now();
+    }
+    void lap(uint timer){
+      if (!profiler_) return;
+      clock::time_point now=clock::now();
+      profiler_->add(timer, now-last_);
+      last_=now;
+    }
+   private:
+    const miniProfiler * profiler_;
+    clock::time_point last_;
+  };
+
+  //the table sorted by time, and the tree and csv file if requested
+  void report() const {
+    if (!enabled_) return;
+    std::vector<uint> order(names_.size());
+    for (uint t=0;t!=order.size();++t) order[t]=t;
+    std::sort(order.begin(), order.end(), byTime(times_));
+
+    std::ostringstream out;
+    out<<name_<<" profile of "<<events_<<" events\n"
+       <<std::setw(12)<<"total [s]"<<std::setw(12)<<"calls"<<std::setw(14)<<"ns/call"<<std::setw(12)<<"ms/event"<<"  part\n";
+    for (uint i=0;i!=order.size();++i){
+      uint t=order[i];
+      double seconds=std::chrono::duration<double>(times_[t]).count();
+      out<<std::setw(12)<<std::setprecision(4)<<seconds<<std::setw(12)<<calls_[t]
+	 <<std::setw(14)<<std::setprecision(4)<<(calls_[t] ? 1e9*seconds/calls_[t] : 0.)
+	 <<std::setw(12)<<std::setprecision(4)<<(events_ ? 1e3*seconds/events_ : 0.)<<"  "<<names_[t]<<"\n";
+    }
+    edm::LogVerbatim("miniProfiler")<<out.str();
+
+    if (writeTree_){
+      edm::Service<TFileService> fs;
+      TTree * tree=fs->make<TTree>(("profile_"+name_).c_str(), (name_+" profile").c_str());
+      std::string * part=new std::string;
+      ULong64_t calls=0;
+      double seconds=0;
+      tree->Branch("part", &part);
+      tree->Branch("calls", &calls, "calls/l");
+      tree->Branch("seconds", &seconds, "seconds/D");
+      for (uint i=0;i!=order.size();++i){
+	*part=names_[order[i]];
+	calls=calls_[order[i]];
+	seconds=std::chrono::duration<double>(times_[order[i]]).count();
+	tree->Fill();
+      }
+      tree->ResetBranchAddresses();
+      delete part;
+    }
+
+    if (csv_!=""){
+      //one file per ntupler, e.g. profile_miniStringBasedNTupler.csv for profileCSV = 'profile'
+      std::string fileName=csv_+"_"+name_+".csv";
+      std::ofstream csv(fileName.c_str());
+      csv<<"part,calls,seconds,events\n";
+      for (uint i=0;i!=order.size();++i)
+	csv<<"\""<<names_[order[i]]<<"\","<<calls_[order[i]]<<","
+	   <<std::setprecision(9)<<std::chrono::duration<double>(times_[order[i]]).count()<<","<<events_<<"\n";
+      if (!csv) edm::LogError("miniProfiler")<<"cannot write: "<<fileName;
+    }
+  }
+
+ private:
+  struct byTime {
+    byTime(const std::vector<clock::duration> & times) : times_(times) {}
+    bool operator()(uint a, uint b) const { return times_[a]>times_[b];}
+    const std::vector<clock::duration> & times_;
+  };
+
+  std::string name_;
+  bool enabled_;
+  bool writeTree_;
+  std::string csv_;
+  std::vector<std::string> names_;
+  //updated from const code while filling: the timers are all created before
+  mutable std::vector<clock::duration> times_;
+  mutable std::vector<unsigned long> calls_;
+  mutable unsigned long events_;
+};
+
+#endif
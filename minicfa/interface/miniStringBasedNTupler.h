@@ -4,6 +4,7 @@
 //#include "PhysicsTools/UtilAlgos/interface/UpdaterService.h"
 
 #include "FWCore/Utilities/interface/InputTag.h"
+#include "FWCore/Utilities/interface/Exception.h"
 #include "FWCore/Framework/interface/Frameworkfwd.h"
 #include "FWCore/Framework/interface/EDProducer.h"
 #include "FWCore/Framework/interface/EDFilter.h"
@@ -16,6 +17,10 @@
 #include "TFile.h"
 
 #include "PhysicsTools/UtilAlgos/interface/NTupler.h"
+#include "CfANtupler/minicfa/interface/miniCompiledLeaves.h"
+#include "CfANtupler/minicfa/interface/miniJobSummary.h"
+#include "CfANtupler/minicfa/interface/miniProfiler.h"
+#include "CfANtupler/minicfa/interface/miniStringDictionary.h"
 
 #include "FWCore/Framework/interface/Event.h"
 #include "FWCore/MessageLogger/interface/MessageLogger.h"
@@ -32,7 +37,12 @@
 
 //#define miniStringBasedNTuplerPrecision float;
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
 
@@ -45,12 +55,126 @@
 // LHE Event
 #include "SimDataFormats/GeneratorProducts/interface/LHEEventProduct.h"
 
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
+
+
+class miniTreeBranch;
+
+//per-event data holder of a leaf, a vector in the type declared for the leaf
+class miniLeafBuffer {
+ public:
+  virtual ~miniLeafBuffer(){}
+  //hands a new empty vector to the tree or the event, deleting the one held if any
+  virtual void allocate()=0;
+  virtual bool allocated() const =0;
+  virtual void clear()=0;
+  virtual void reserve(size_t n)=0;
+  virtual size_t capacity() const =0;
+  virtual void push_back(double v)=0;
+
+  virtual TBranch * branch(TTree * tree, const std::string & alias)=0;
+  virtual void produces(edm::ProducerBase * producer, const std::string & name, const std::string & alias) const =0;
+  //gives the vector held to the event
+  virtual void put(edm::Event & iEvent, const std::string & name)=0;
+
+  //types as in the ROOT leaf lists: B (int8), S (int16), I (int32), F (float), D (double), O (bool)
+  static bool knownType(char type) { return std::string("BSIFDO").find(type)!=std::string::npos;}
+  static miniLeafBuffer * make(char type);
+};
+
+template <typename T>
+class miniTypedLeafBuffer : public miniLeafBuffer {
+ public:
+  miniTypedLeafBuffer() : data_(0) {}
+  ~miniTypedLeafBuffer(){ delete data_;}
+  void allocate(){ delete data_; data_=new std::vector<T>();}
+  bool allocated() const { return data_!=0;}
+  void clear(){ data_->clear();}
+  void reserve(size_t n){ data_->reserve(n);}
+  size_t capacity() const { return data_->capacity();}
+  void push_back(double v){ data_->push_back(static_cast<T>(v));}
+
+  TBranch * branch(TTree * tree, const std::string & alias){ return tree->Branch(alias.c_str(), &data_);}
+  void produces(edm::ProducerBase * producer, const std::string & name, const std::string & alias) const {
+    producer->produces<std::vector<T> >(name).setBranchAlias(alias);
+  }
+  void put(edm::Event & iEvent, const std::string & name){
+    std::auto_ptr<std::vector<T> > product(data_);
+    data_=0;
+    iEvent.put(product, name);
+  }
+ private:
+  std::vector<T> * data_;
+};
+
+inline miniLeafBuffer * miniLeafBuffer::make(char type){
+  switch (type){
+  case 'B': return new miniTypedLeafBuffer<signed char>();
+  case 'S': return new miniTypedLeafBuffer<short>();
+  case 'I': return new miniTypedLeafBuffer<int>();
+  case 'D': return new miniTypedLeafBuffer<double>();
+  case 'O': return new miniTypedLeafBuffer<bool>();
+  default : return new miniTypedLeafBuffer<float>();
+  }
+}
+
+//base class of the evaluators. One evaluator serves all the leaves of a collection: the product is
+//fetched, selected and sorted once per event, then every leaf expression is evaluated on each kept object.
+//The expressions are parsed once, when the collection is configured
+class miniBranchHelper {
+ public:
+  virtual ~miniBranchHelper(){}
+  //fills values[l] for the l-th leaf of the collection, and returns the number of kept objects
+  virtual uint fill(const edm::Event& iEvent, std::vector<miniLeafBuffer*> & values) const =0;
+  //end of job report, if any
+  virtual void summarize(std::ostream & out) const {}
+  //whether the collection can be filled while the others are (parallelCollections), see miniConcurrentLeaf
+  virtual bool concurrent() const { return false;}
+
+  //the collections can be filled concurrently (parallelCollections). This lock serializes the getByLabel
+  //of the collections: edm::Event records the products it returned in a container that is not safe to
+  //update from several threads. The Refs and Ptrs followed by the leaves can read their product from the
+  //file on first use, which is not safe either: the collections that may follow them are filled alone
+  static std::mutex & eventMutex();
+};
+
+//whether expr can be evaluated on the objects of className while other collections are filled. Only what is
+//proven safe is: a chain of members with literal arguments ("pt", "track.pt", "tauID('x')"), each found in
+//the dictionary and returning neither a Ref, Ptr or RefToBase nor a pointer, on a class that is not unpacked
+//lazily (pat::PackedCandidate, pat::PackedGenParticle). Anything else may read a product or update a cache
+//shared with another collection. An empty expression is safe
+bool miniConcurrentLeaf(const std::string & className, const std::string & expr);
+
+//job wide options of the evaluation of the leaves, from the branchesPSet and the Ntupler PSet
+struct miniEvaluationOptions {
+  miniEvaluationOptions() : compiled(0), validateCompiled(false), profiler(0) {}
+  const miniCompiledLeaves * compiled; //compiledLeaves plugin, 0 if none
+  bool validateCompiled;
+  miniProfiler * profiler; //0 if not profiling
+};
+
+//registry of the classes a branch can be made of: the class name of a collection is resolved
+//once, at configuration, into the factory of its evaluator. The list lives in miniStringBasedNTupler.cc
+class miniBranchHelperRegistry {
+ public:
+  typedef miniBranchHelper * (*factory)(const std::vector<miniTreeBranch> &, const miniEvaluationOptions & options);
+  static const miniBranchHelperRegistry & get();
+  //returns 0 for a class that is not registered
+  factory find(const std::string & className) const {
+    std::map<std::string, factory>::const_iterator f=factories_.find(className);
+    return (f==factories_.end()) ? 0 : f->second;
+  }
+ private:
+  miniBranchHelperRegistry();
+  std::map<std::string, factory> factories_;
+};
 
 class miniTreeBranch {
  public:
-  miniTreeBranch(): class_(""),expr_(""),order_(""),selection_(""),maxIndexName_(""),branchAlias_("") {}
-    miniTreeBranch(std::string C, edm::InputTag S, std::string E, std::string O, std::string SE, std::string Mi, std::string Ba) :
-      class_(C),src_(S),expr_(E),order_(O), selection_(SE),maxIndexName_(Mi),branchAlias_(Ba){
+  miniTreeBranch(): class_(""),expr_(""),order_(""),selection_(""),maxIndexName_(""),branchAlias_(""),type_('F') {}
+    miniTreeBranch(std::string C, edm::InputTag S, std::string E, std::string O, std::string SE, std::string Mi, std::string Ba, char T='F') :
+      class_(C),src_(S),expr_(E),order_(O), selection_(SE),maxIndexName_(Mi),branchAlias_(Ba),type_(T),buffer_(miniLeafBuffer::make(T)){
       branchTitle_= E+" calculated on "+C+" object from "+S.encode();
       if (O!="") branchTitle_+=" ordered according to "+O;
       if (SE!="") branchTitle_+=" selecting on "+SE;
@@ -69,12 +193,21 @@ class miniTreeBranch {
 	return std::string(name.c_str());}
   const std::string & branchAlias()const{ return branchAlias_;}
   const std::string & branchTitle()const{ return branchTitle_;}
-  typedef std::auto_ptr<std::vector<float> > value;
-  value branch(const edm::Event& iEvent);
 
-  std::vector<float>** dataHolderPtrAdress() { return &dataHolderPtr_;}
-  std::vector<float>* dataHolderPtr() { return dataHolderPtr_;}
-  void assignDataHolderPtr(std::vector<float> * data) { dataHolderPtr_=data;}
+  char type() const { return type_;}
+
+  //the data holder, shared by the copies of the branch
+  miniLeafBuffer & buffer() { return *buffer_;}
+
+  //strips a type suffix (e.g. "charge:I") from a leaf expression, returning the type ('F' if none)
+  static char splitType(std::string & expr, const std::string & separator){
+    if (expr.size()<=separator.size()+1) return 'F';
+    size_t sep=expr.size()-1-separator.size();
+    char type=expr[expr.size()-1];
+    if (expr.compare(sep, separator.size(), separator)!=0 || !miniLeafBuffer::knownType(type)) return 'F';
+    expr=expr.substr(0,sep);
+    return type;
+  }
  private:
   std::string class_;
   edm::InputTag src_;
@@ -84,126 +217,417 @@ class miniTreeBranch {
   std::string maxIndexName_;
   std::string branchAlias_;
   std::string branchTitle_;
+  char type_;
+
+  std::shared_ptr<miniLeafBuffer> buffer_;
+};
+
+//the leaves made from one collection (they share class, source, selection and order) and their evaluator
+class miniTreeCollection {
+ public:
+  miniTreeCollection() : profiler_(0), timer_(0) {}
+  std::vector<miniTreeBranch> & leaves() { return leaves_;}
+  const std::vector<miniTreeBranch> & leaves() const { return leaves_;}
+  void addLeaf(const miniTreeBranch & b) { leaves_.push_back(b);}
+
+  //parse all the expressions: a bad expression or class stops the job here and not silently per event.
+  //The leaves found in options.compiled are evaluated with their compiled accessor, see miniCompiledLeafSet
+  void configure(const miniEvaluationOptions & options);
+
+  void summarize(std::ostream & out) const { helper_->summarize(out);}
+  bool concurrent() const { return helper_->concurrent();}
+
+  //fills the data holders of the leaves and returns the number of kept objects.
+  //With reuseBuffers the vectors already held by the leaves are cleared and refilled, keeping their capacity,
+  //otherwise a new vector is handed to each leaf, to be deleted or put in the event by the caller.
+  //nAllocations is incremented for every vector created or grown
+  uint fill(const edm::Event& iEvent, bool reuseBuffers, uint & nAllocations){
+    miniProfiler::Sentry sentry(profiler_, timer_);
+    values_.resize(leaves_.size());
+    capacities_.resize(leaves_.size());
+    for (uint l=0;l!=leaves_.size();++l){
+      values_[l]=&leaves_[l].buffer();
+      if (reuseBuffers && values_[l]->allocated()){
+	values_[l]->clear();
+      }else{
+	values_[l]->allocate();
+	++nAllocations;
+      }
+      capacities_[l]=values_[l]->capacity();
+    }
+    uint n=helper_->fill(iEvent, values_);
+    for (uint l=0;l!=leaves_.size();++l)
+      if (values_[l]->capacity()!=capacities_[l]) ++nAllocations;
+    return n;
+  }
+ private:
+  std::vector<miniTreeBranch> leaves_;
+  std::shared_ptr<const miniBranchHelper> helper_;
+  const miniProfiler * profiler_;
+  uint timer_;
+  //per event scratch, kept to not reallocate it
+  std::vector<miniLeafBuffer*> values_;
+  std::vector<size_t> capacities_;
+};
+
+
+//parses the expressions of all the leaves, adding the branch name to the error of a bad one
+template <typename Object>
+std::vector<StringObjectFunction<Object> > parseLeaves(const std::vector<miniTreeBranch> & leaves){
+  std::vector<StringObjectFunction<Object> > exprs;
+  exprs.reserve(leaves.size());
+  for (uint l=0;l!=leaves.size();++l){
+    try{
+      exprs.push_back(StringObjectFunction<Object>(leaves[l].expr()));
+    }catch(cms::Exception & e){
+      e.addContext("configuring the branch "+leaves[l].branchAlias()+" ("+leaves[l].branchTitle()+")");
+      throw;
+    }
+  }
+  return exprs;
+}
+
+//the compiled accessors of the leaves of a collection (0 for a leaf left to the string evaluator).
+//With validate, both evaluators are run on every object: the string value is the one stored, and the
+//timing of the two and the number of values that differ are reported at the end of the job
+class miniCompiledLeafSet {
+ public:
+  miniCompiledLeafSet(const std::vector<miniTreeBranch> & leaves, const miniCompiledLeaves * compiled, bool validate);
+
+  miniCompiledAccessor operator[](uint l) const { return accessors_[l];}
+  bool validate() const { return validate_;}
+
+  //evaluates the l-th leaf both ways on o, and returns the string based value
+  template <typename Object>
+  double validate(uint l, const Object & o, const StringObjectFunction<Object> & expr, double defaultValue) const {
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start=clock::now();
+    double stringValue=defaultValue;
+    try{ stringValue=expr(o);}catch(...){ stringValue=defaultValue;}
+    clock::time_point middle=clock::now();
+    double compiledValue=defaultValue;
+    //the generated accessors call members that can throw, e.g. electronID("...") of a missing ID
+    try{ if (!accessors_[l](&o, compiledValue)) compiledValue=defaultValue;}catch(...){ compiledValue=defaultValue;}
+    clock::time_point stop=clock::now();
+
+    stringTime_[l]+=middle-start;
+    compiledTime_[l]+=stop-middle;
+    ++evaluations_[l];
+    if (std::memcmp(&stringValue, &compiledValue, sizeof(double))!=0) ++mismatches_[l];
+    return stringValue;
+  }
+
+  void summarize(std::ostream & out) const;
+
+ private:
+  std::vector<miniCompiledAccessor> accessors_;
+  std::vector<std::string> aliases_;
+  bool validate_;
+  //validation counters, updated from the const fill(...) of the evaluators
+  mutable std::vector<std::chrono::steady_clock::duration> stringTime_, compiledTime_;
+  mutable std::vector<unsigned long> evaluations_, mismatches_;
+};
+
+//a member followed without the string evaluator: one returning a reference that can be null or not available,
+//on which the string evaluator throws, or one returning a const reference, shared by many leaves.
+//get returns the object reached, or 0 instead of throwing
+struct miniHop {
+  typedef const void * (*getter)(const void * object);
+  miniHop() : get(0) {}
+  miniHop(const std::string & T, getter G) : target(T), get(G) {}
+  std::string target;
+  getter get;
+};
+
+//the string evaluator of an expression on an object of the class reached by the hops of a leaf
+class miniLeafTail {
+ public:
+  virtual ~miniLeafTail(){}
+  virtual double operator()(const void * object) const =0;
+};
+
+template <typename T>
+class miniTypedLeafTail : public miniLeafTail {
+ public:
+  miniTypedLeafTail(const std::string & expr) : expr_(expr) {}
+  double operator()(const void * object) const { return expr_(*static_cast<const T*>(object));}
+ private:
+  StringObjectFunction<T> expr_;
+};
+
+//registry of the hops, per class, and of the classes they lead to. The lists live in miniStringBasedNTupler.cc
+class miniHopRegistry {
+ public:
+  typedef miniLeafTail * (*tailFactory)(const std::string & expr);
+  static const miniHopRegistry & get();
+  //returns 0 if member is not a registered member of className
+  const miniHop * find(const std::string & className, const std::string & member) const {
+    std::map<std::string, miniHop>::const_iterator h=hops_.find(className+"::"+member);
+    return (h==hops_.end()) ? 0 : &h->second;
+  }
+  //returns 0 for a class without tail evaluator
+  tailFactory findTail(const std::string & className) const {
+    std::map<std::string, tailFactory>::const_iterator t=tails_.find(className);
+    return (t==tails_.end()) ? 0 : t->second;
+  }
+ private:
+  miniHopRegistry();
+  std::map<std::string, miniHop> hops_;
+  std::map<std::string, tailFactory> tails_;
+};
+
+//the leading hops of the leaves of a collection, merged in a tree: genParticle.mother.pdgId and
+//genParticle.mother.status share the genParticle and mother nodes, which are followed once per object.
+//The rest of each expression is evaluated on the object reached, and a null reference on the way makes
+//the leaf invalid without an exception thrown and caught for every object
+class miniHopTree {
+ public:
+  //the node reached by the leading hops of expr on className, and the evaluator of the rest of the expression.
+  //Returns -1 (and no tail) if expr does not start with a registered hop
+  int add(const std::string & className, const std::string & expr, std::shared_ptr<const miniLeafTail> & tail);
+
+  bool empty() const { return nodes_.empty();}
+
+  //follows all the hops from object, before the leaves of this object are evaluated. The parents come first.
+  //A getter that throws (e.g. a Ref to a product not available) fails its node and the nodes below it
+  void resolve(const void * object) const {
+    for (uint n=0;n!=nodes_.size();++n){
+      const Node & node=nodes_[n];
+      failed_[n]=(node.parent>=0) && failed_[node.parent];
+      const void * from=(node.parent<0) ? object : objects_[node.parent];
+      objects_[n]=0;
+      if (!from) continue;
+      try{
+	objects_[n]=node.get(from);
+      }catch(...){
+	failed_[n]=true;
+      }
+    }
+  }
+  //the object reached at node, 0 if a reference was null or a getter failed on the way
+  const void * object(int node) const { return objects_[node];}
+  bool failed(int node) const { return failed_[node];}
 
-  std::vector<float> * dataHolderPtr_;
+ private:
+  struct Node {
+    int parent;
+    std::string member;
+    miniHop::getter get;
+  };
+  std::vector<Node> nodes_;
+  //per object scratch
+  mutable std::vector<const void *> objects_;
+  mutable std::vector<char> failed_;
 };
 
+//evaluates the leaves of a collection on one object: with the compiled accessor if there is one, else through
+//the hop tree if the leaf starts with registered hops, else with the string evaluator. A leaf is invalid (null
+//reference) or fails (exception caught) on an object without stopping the others: its default value is stored,
+//and the number of invalid and failed evaluations of each leaf is reported at the end of the job
+template <typename Object>
+class miniLeafEvaluator {
+ public:
+  miniLeafEvaluator(const std::vector<miniTreeBranch> & leaves, const miniEvaluationOptions & options) :
+    exprs_(parseLeaves<Object>(leaves)), compiled_(leaves, options.compiled, options.validateCompiled),
+    nodes_(leaves.size(), -1), tails_(leaves.size()),
+    profiler_((options.profiler && options.profiler->enabled()) ? options.profiler : 0), hopsTimer_(0),
+    concurrent_(true), invalid_(leaves.size(), 0), exceptions_(leaves.size(), 0), selectionExceptions_(0) {
+    for (uint l=0;l!=leaves.size();++l){
+      aliases_.push_back(leaves[l].branchAlias());
+      //whatever evaluates it: compiled accessor, hops or string evaluator
+      if (!miniConcurrentLeaf(leaves[l].className(), leaves[l].expr())) concurrent_=false;
+      if (!compiled_[l]) nodes_[l]=hops_.add(leaves[l].className(), leaves[l].expr(), tails_[l]);
+      if (profiler_) timers_.push_back(options.profiler->timer("leaf "+leaves[l].branchAlias()));
+    }
+    if (profiler_ && !hops_.empty()) hopsTimer_=options.profiler->timer("hops "+leaves.front().maxIndexName());
+  }
+
+  uint size() const { return exprs_.size();}
+  bool concurrent() const { return concurrent_;}
+
+  //to be called on each object, before its leaves
+  void resolve(const Object & o) const {
+    if (hops_.empty()) return;
+    miniProfiler::Sentry sentry(profiler_, hopsTimer_);
+    hops_.resolve(&o);
+  }
+
+  double operator()(uint l, const Object & o) const {
+    if (!profiler_) return evaluate(l, o);
+    miniProfiler::Sentry sentry(profiler_, timers_[l]);
+    return evaluate(l, o);
+  }
+
+  //the selection could not be evaluated on an object: all its leaves get the default value
+  void selectionFailed() const { ++selectionExceptions_;}
+
+  void summarize(std::ostream & out) const {
+    compiled_.summarize(out);
+    if (selectionExceptions_!=0)
+      out<<aliases_.front()<<" ...: the selection failed on "<<selectionExceptions_<<" objects\n";
+    for (uint l=0;l!=aliases_.size();++l){
+      if (invalid_[l]==0 && exceptions_[l]==0) continue;
+      out<<aliases_[l]<<": "<<invalid_[l]<<" null references, "<<exceptions_[l]<<" exceptions\n";
+    }
+  }
+
+ private:
+  double evaluate(uint l, const Object & o) const {
+    const double defaultValue = 0.;
+    double value=defaultValue;
+    if (compiled_[l] && compiled_.validate()) return compiled_.validate(l, o, exprs_[l], defaultValue);
+    try{
+      if (compiled_[l]){
+	if (compiled_[l](&o, value)) return value;
+	++invalid_[l];
+	return defaultValue;
+      }
+      if (nodes_[l]<0) return exprs_[l](o);
+      const void * object=hops_.object(nodes_[l]);
+      if (object) return (*tails_[l])(object);
+      if (hops_.failed(nodes_[l])) ++exceptions_[l];
+      else ++invalid_[l];
+    }catch(...){
+      ++exceptions_[l];
+    }
+    return defaultValue;
+  }
+
+  std::vector<StringObjectFunction<Object> > exprs_;
+  miniCompiledLeafSet compiled_;
+  miniHopTree hops_;
+  //node of the hop tree and evaluator of the rest of the expression of each leaf (-1 and 0 if none)
+  std::vector<int> nodes_;
+  std::vector<std::shared_ptr<const miniLeafTail> > tails_;
+  std::vector<std::string> aliases_;
+  const miniProfiler * profiler_;
+  std::vector<uint> timers_;
+  uint hopsTimer_;
+  bool concurrent_;
+  //failure counters, updated from the const fill(...) of the helpers
+  mutable std::vector<unsigned long> invalid_, exceptions_;
+  mutable unsigned long selectionExceptions_;
+};
 
 template <typename Object>
-class StringLeaveHelper {
+class StringLeaveHelper : public miniBranchHelper {
  public:
-  typedef miniTreeBranch::value value;
-  value operator()() { return value_;}
+  StringLeaveHelper(const std::vector<miniTreeBranch> & leaves, const miniEvaluationOptions & options) :
+    src_(leaves.front().src()), leaves_(leaves, options) {}
 
-  StringLeaveHelper(const miniTreeBranch & B, const edm::Event& iEvent)
+  uint fill(const edm::Event& iEvent, std::vector<miniLeafBuffer*> & values) const
     {
-      const float defaultValue = 0.;
       //    grab the object
       edm::Handle<Object> oH;
-      iEvent.getByLabel(B.src(), oH);
+      {
+	std::lock_guard<std::mutex> lock(eventMutex());
+	iEvent.getByLabel(src_, oH);
+      }
       //empty vector if product not found
       if (oH.failedToGet() ) {
-	if (!(iEvent.isRealData() && (B.src().label()==std::string("generator")) ) ) {  //don't output generator error in data 
-	  edm::LogError("StringBranchHelper")<<"cannot open: "<<B.src();
-	}
-	value_.reset(new std::vector<float>(0));
-      }
-      else{
-	//parser for the object expression
-	StringObjectFunction<Object> expr(B.expr());
-	//allocate enough memory for the data holder
-	value_.reset(new std::vector<float>(1));
-	try{
-	  (*value_)[0]=(expr)(*oH);
-	}catch(...){
-	  LogDebug("StringLeaveHelper")<<"could not evaluate expression: "<<B.expr()<<" on class: "<<B.className();
-	  (*value_)[0]=defaultValue;
+	if (!(iEvent.isRealData() && (src_.label()==std::string("generator")) ) ) {  //don't output generator error in data 
+	  edm::LogError("StringBranchHelper")<<"cannot open: "<<src_;
 	}
+	return 0;
       }
+      leaves_.resolve(*oH);
+      for (uint l=0;l!=leaves_.size();++l)
+	values[l]->push_back(leaves_(l, *oH));
+      return 1;
     }
+
+  void summarize(std::ostream & out) const { leaves_.summarize(out);}
+  bool concurrent() const { return leaves_.concurrent();}
+
  private:
-  value value_;
+  edm::InputTag src_;
+  miniLeafEvaluator<Object> leaves_;
 };
 
 template <typename Object, typename Collection=std::vector<Object> >
-class StringBranchHelper {
+class StringBranchHelper : public miniBranchHelper {
 public:
-  typedef miniTreeBranch::value value;
-  value operator()() { return value_;}
+  StringBranchHelper(const std::vector<miniTreeBranch> & leaves, const miniEvaluationOptions & options) :
+    src_(leaves.front().src()), className_(leaves.front().className()),
+    leaves_(leaves, options), selectionExpr_(leaves.front().selection()), orderExpr_(leaves.front().order()),
+    selection_(leaves.front().selection()!="" ? new StringCutObjectSelector<Object>(leaves.front().selection()) : 0),
+    order_(leaves.front().order()!="" ? new StringObjectFunction<Object>(leaves.front().order()) : 0) {}
 
-  StringBranchHelper(const miniTreeBranch & B, const edm::Event& iEvent)
+  uint fill(const edm::Event& iEvent, std::vector<miniLeafBuffer*> & values) const
     {
       const float defaultValue = 0.;
 
       //    grab the collection
       edm::Handle<Collection> oH;
-      iEvent.getByLabel(B.src(), oH);
+      {
+	std::lock_guard<std::mutex> lock(eventMutex());
+	iEvent.getByLabel(src_, oH);
+      }
 
       //empty vector if product not found
       if (oH.failedToGet()){
-	if (!(iEvent.isRealData() && (B.className()=="reco::GenParticle")) ) {  //don't output genparticle error in data 
-  	  edm::LogError("StringBranchHelper")<<"cannot open: "<<B.src()<<"  "<<B.className();
+	if (!(iEvent.isRealData() && (className_=="reco::GenParticle")) ) {  //don't output genparticle error in data 
+  	  edm::LogError("StringBranchHelper")<<"cannot open: "<<src_<<"  "<<className_;
         }
-        value_.reset(new std::vector<float>());
+        return 0;
       }
-      else{
-	//parser for the object expression
-	StringObjectFunction<Object> expr(B.expr());
-	//allocate enough memory for the data holder
-        value_.reset(new std::vector<float>());
-        value_->reserve(oH->size());
-
-	StringCutObjectSelector<Object> * selection=0;
-	if (B.selection()!="")
-	  selection = new StringCutObjectSelector<Object>(B.selection());
-
-	uint i_end=oH->size();
-	//sort things first if requested
-	if (B.order()!=""){
-	  StringObjectFunction<Object> order(B.order());
-	  // allocate a vector of pointers (we are using view) to be sorted
-	  std::vector<const Object*> copyToSort(oH->size()); 
-	  for (uint i=0;i!=i_end;++i)  copyToSort[i]= &(*oH)[i];
-	  std::sort(copyToSort.begin(), copyToSort.end(), sortByStringFunction<Object>(&order)); 
-	  //then loop and fill
-	  for (uint i=0;i!=i_end;++i) {
-	    //try and catch is necessary because ...
-	    try{ 
-	      if (selection && !((*selection)(*(copyToSort)[i]))) continue;
-	      value_->push_back((expr)(*(copyToSort)[i]));
-	    }catch(...){ 
-	      LogDebug("StringBranchHelper")<<"with sorting. could not evaluate expression: "<<B.expr()<<" on class: "<<B.className();
-	      value_->push_back(defaultValue);//push a default value to not change the indexing
-	    } 
-	  }
-	}
-	else{
-	  //actually fill the vector of values
-	  for (uint i=0;i!=i_end;++i){
-	    //try and catch is necessary because ...
-	    try {
-	      if (selection && !((*selection)((*oH)[i]))) continue;
-	      value_->push_back((expr)((*oH)[i])); 
-	    }catch(...){ 
-	      LogDebug("StringBranchHelper")<<"could not evaluate expression: "<<B.expr()<<" on class: "<<B.className(); 
-	      value_->push_back(defaultValue);//push a default value to not change the indexing
-	    } 
+
+      uint i_end=oH->size();
+      uint nLeaves=leaves_.size();
+      //allocate enough memory for the data holders
+      for (uint l=0;l!=nLeaves;++l) values[l]->reserve(i_end);
+
+      // a vector of pointers (we are using view), sorted once for all the leaves if requested
+      std::vector<const Object*> objects(i_end);
+      for (uint i=0;i!=i_end;++i)  objects[i]= &(*oH)[i];
+      if (order_.get())
+	std::sort(objects.begin(), objects.end(), sortByStringFunction<Object>(order_.get()));
+
+      //then loop the objects once and fill all the leaves
+      uint nKept=0;
+      for (uint i=0;i!=i_end;++i){
+	const Object & o=*objects[i];
+	//the selection is evaluated once for all the leaves
+	bool failed=false;
+	if (selection_.get()){
+	  //try and catch is necessary because ...
+	  try{
+	    if (!(*selection_)(o)) continue;
+	  }catch(...){
+	    leaves_.selectionFailed();
+	    failed=true;
 	  }
 	}
-	if (selection) delete selection;
+	if (!failed) leaves_.resolve(o);
+	for (uint l=0;l!=nLeaves;++l)
+	  values[l]->push_back(failed ? defaultValue : leaves_(l, o));//a default value to not change the indexing
+	++nKept;
       }
+      return nKept;
     }
+
+  void summarize(std::ostream & out) const { leaves_.summarize(out);}
+  bool concurrent() const {
+    return leaves_.concurrent() && miniConcurrentLeaf(className_, selectionExpr_) && miniConcurrentLeaf(className_, orderExpr_);
+  }
+
  private:
-  value value_;
+  edm::InputTag src_;
+  std::string className_;
+  //evaluators of the leaves, the selection and the sorting
+  miniLeafEvaluator<Object> leaves_;
+  std::string selectionExpr_, orderExpr_;
+  std::unique_ptr<StringCutObjectSelector<Object> > selection_;
+  std::unique_ptr<StringObjectFunction<Object> > order_;
 };
 
 
 
-class miniStringBasedNTupler : public NTupler {
+class miniStringBasedNTupler : public NTupler, public miniJobSummary {
 
 
  public:
-  miniStringBasedNTupler(const edm::ParameterSet& iConfig){
+  miniStringBasedNTupler(const edm::ParameterSet& iConfig) : profiler_("miniStringBasedNTupler", iConfig) {
 
 
 
@@ -229,13 +653,16 @@ class miniStringBasedNTupler : public NTupler {
       std::string maxName="N"+branches[b];
       for (uint l=0;l!=leaves.size();++l){
 	std::string leave_expr=leavesPSet.getParameter<std::string>(leaves[l]);
+	//optional type of the leaf [string x = "x:I"]
+	char type=miniTreeBranch::splitType(leave_expr, separator);
 	std::string branchAlias=branches[b]+"_"+leaves[l];
 	
 	//add a branch manager for this expression on this collection
-	branches_[maxName].push_back(miniTreeBranch(className, src, leave_expr, selection, order, maxName, branchAlias));
+	branches_[maxName].addLeaf(miniTreeBranch(className, src, leave_expr, order, selection, maxName, branchAlias, type));
       }//loop the provided leaves
       
       //do it once with configuration [vstring vars = { "x:x" ,... } ] where ":"=separator
+      //a leaf can be given a type with a last field, as in ROOT leaf lists: "x:x:I" (see miniLeafBuffer)
       if (leavesPSet.exists("vars")){
 	std::vector<std::string> leavesS = leavesPSet.getParameter<std::vector<std::string> >("vars");
 	for (uint l=0;l!=leavesS.size();++l){
@@ -250,15 +677,56 @@ class miniStringBasedNTupler : public NTupler {
 	    space = name.find(" ");
 	  }
 	  std::string expr=leavesS[l].substr(sep+1);
+	  //optional type of the leaf [ "x:x:I" ]
+	  char type=miniTreeBranch::splitType(expr, separator);
 	  std::string branchAlias=branches[b]+"_"+name;
 
 	  //add a branch manager for this expression on this collection
-	  branches_[maxName].push_back(miniTreeBranch(className, src, expr, order, selection, maxName, branchAlias));
+	  branches_[maxName].addLeaf(miniTreeBranch(className, src, expr, order, selection, maxName, branchAlias, type));
 	}
       }
 
     }//loop the provided branches
 
+    //leaf expressions compiled by minicfa/scripts/generateCompiledLeaves.py, optional
+    miniEvaluationOptions options;
+    std::string compiledLeaves=branchesPSet.getUntrackedParameter<std::string>("compiledLeaves","");
+    options.validateCompiled=branchesPSet.getUntrackedParameter<bool>("validateCompiledLeaves",false);
+    if (compiledLeaves!=""){
+      compiledLeaves_.reset(miniCompiledLeavesFactory::get()->tryToCreate(compiledLeaves));
+      if (!compiledLeaves_.get())
+	edm::LogWarning("miniStringBasedNTupler")<<"no compiled leaves plugin named: "<<compiledLeaves
+						 <<". All the leaves are evaluated from their string expression";
+    }
+
+    //one evaluator per collection, all the expressions parsed now
+    options.compiled=compiledLeaves_.get();
+    if (profiler_.enabled()) options.profiler=&profiler_;
+    fillTimer_=profiler_.timer("fill");
+    eventInfoTimer_=profiler_.timer("event info and weights");
+    treeFillTimer_=profiler_.timer("TTree::Fill");
+    for (Branches::iterator iB=branches_.begin();iB!=branches_.end();++iB){
+      iB->second.configure(options);
+      collections_.push_back(&iB->second);
+    }
+
+    //evaluate the collections of an event concurrently, in the tasks of the framework. The ones that may
+    //read other products or share lazily unpacked objects are filled afterwards, alone
+    parallelCollections_=branchesPSet.getUntrackedParameter<bool>("parallelCollections",false);
+    if (parallelCollections_){
+      std::string serial;
+      for (size_t c=0;c!=collections_.size();++c){
+	if (collections_[c]->concurrent())
+	  parallelIndices_.push_back(c);
+	else{
+	  serialIndices_.push_back(c);
+	  serial+=" "+collections_[c]->leaves().front().maxIndexName();
+	}
+      }
+      if (!serial.empty())
+	edm::LogInfo("miniStringBasedNTupler")<<"collections filled after the concurrent ones, one at a time:"<<serial;
+    }
+
 
 
 
@@ -272,6 +740,9 @@ class miniStringBasedNTupler : public NTupler {
     weightVector_ = new std::vector<float>;
     weightIndex_ = new std::vector<int>;
     model_params_ = new std::string;
+    model_id_ = new Long64_t;
+    //the LHE model comment of every event, besides its model_id
+    modelParamsPerEvent_=branchesPSet.exists("modelParamsPerEvent") && branchesPSet.getParameter<bool>("modelParamsPerEvent");
 
 
     if (branchesPSet.exists("useTFileService"))
@@ -279,6 +750,10 @@ class miniStringBasedNTupler : public NTupler {
     else
       useTFileService_=iConfig.getParameter<bool>("useTFileService");
 
+    //keep one vector per leaf for the whole job instead of a new one per event (TFileService only)
+    reuseBuffers_=branchesPSet.getUntrackedParameter<bool>("reuseBuffers",true);
+    allocationsLastEvent_=0;
+
     if (useTFileService_){
       if (branchesPSet.exists("treeName")){
 	treeName_=branchesPSet.getParameter<std::string>("treeName");
@@ -327,12 +802,14 @@ class miniStringBasedNTupler : public NTupler {
 	//create a branch for the index: an integer
 	tree_->Branch(iB->first.c_str(), &(indexDataHolder_[indexOfIndexInDataHolder]),(iB->first+"/i").c_str());
 	//loop on the "leaves"
-	std::vector<miniTreeBranch>::iterator iL=iB->second.begin();
-	std::vector<miniTreeBranch>::iterator iL_end=iB->second.end();
+	std::vector<miniTreeBranch>::iterator iL=iB->second.leaves().begin();
+	std::vector<miniTreeBranch>::iterator iL_end=iB->second.leaves().end();
 	for(;iL!=iL_end;++iL){
 	  miniTreeBranch & b=*iL;
-	  //create a branch for the leaves: vector of floats
-	  TBranch * br = tree_->Branch(b.branchAlias().c_str(),"std::vector<float>",iL->dataHolderPtrAdress());
+	  //the vector is owned by the leaf, for the whole job in the buffer reuse mode
+	  b.buffer().allocate();
+	  //create a branch for the leaves: vector of the type of the leaf
+	  TBranch * br = b.buffer().branch(tree_, b.branchAlias());
 	  br->SetTitle(b.branchTitle().c_str());
 	  nLeaves++;
 	}
@@ -348,7 +825,11 @@ class miniStringBasedNTupler : public NTupler {
       tree_->Branch("weight",weight_,"weight/f");
       tree_->Branch("weightIndex",&weightIndex_);
       tree_->Branch("weightVector",&weightVector_);
-      tree_->Branch("model_params",&model_params_);
+      tree_->Branch("model_id",model_id_,"model_id/L");
+      if (modelParamsPerEvent_) tree_->Branch("model_params",&model_params_);
+
+      //the model points of model_id, one entry per run, lumi block and model point
+      modelPoints_.book(fs->make<TTree>("modelPoints","model points of the model_id"), true, "model_id", "model_params");
 
     }
     else{
@@ -359,12 +840,12 @@ class miniStringBasedNTupler : public NTupler {
 	//the index. should produce it only once
 	// a simple uint for the index
 	producer->produces<uint>(iB->first).setBranchAlias(iB->first);
-	std::vector<miniTreeBranch>::iterator iL=iB->second.begin();
-	std::vector<miniTreeBranch>::iterator iL_end=iB->second.end();
+	std::vector<miniTreeBranch>::iterator iL=iB->second.leaves().begin();
+	std::vector<miniTreeBranch>::iterator iL_end=iB->second.leaves().end();
 	for(;iL!=iL_end;++iL){
 	  miniTreeBranch & b=*iL;
-	  //a vector of float for each leave
-	  producer->produces<std::vector<float> >(b.branchName()).setBranchAlias(b.branchAlias());
+	  //a vector of the type of the leaf for each leave
+	  b.buffer().produces(producer, b.branchName(), b.branchAlias());
 	  nLeaves++;
 	}
       }
@@ -376,29 +857,18 @@ class miniStringBasedNTupler : public NTupler {
     //    if (!edm::Service<UpdaterService>()->checkOnce("miniStringBasedNTupler::fill")) return;
     //well if you do that, you cannot have two ntupler of the same type in the same job...
 
+    miniProfiler::Sentry sentry(&profiler_, fillTimer_);
+    profiler_.countEvent();
+    uint nAllocations=0;
     if (useTFileService_){
       // loop the automated leafer
-      Branches::iterator iB=branches_.begin();
-      Branches::iterator iB_end=branches_.end();
-      uint indexOfIndexInDataHolder=0;
-      for(;iB!=iB_end;++iB,++indexOfIndexInDataHolder){
-	std::vector<miniTreeBranch>::iterator iL=iB->second.begin();
-	std::vector<miniTreeBranch>::iterator iL_end=iB->second.end();
-	uint maxS=0;
-	for(;iL!=iL_end;++iL){
-	  miniTreeBranch & b=*iL;
-	  // grab the vector of values from the interpretation of expression for the associated collection
-	  std::auto_ptr<std::vector<float> > branch(b.branch(iEvent));
-	  // calculate the maximum index size.
-	  if (branch->size()>maxS) maxS=branch->size();
-	  // transfer of (no copy) pointer to the vector of float from the auto_ptr to the tree data pointer
-	  b.assignDataHolderPtr(branch.release());
-	  // for memory tracing, object b is holding the data (not auto_ptr) and should delete it for each event (that's not completely optimum)
-	}
-	//assigne the maximum vector size for this collection
-	indexDataHolder_[indexOfIndexInDataHolder]=maxS;
-      }
+      // evaluate all the leaves of each collection in one pass, directly into the tree data holders
+      fillCollections(iEvent, reuseBuffers_, nAllocations);
+      // the number of kept objects is the size of each of the vectors
+      for (uint c=0;c!=collections_.size();++c)
+	indexDataHolder_[c]=kept_[c];
 
+      miniProfiler::Laps laps(&profiler_);
       //fill event info.
       *run_ = iEvent.id().run();
       *ev_ = iEvent.id().event();
@@ -434,62 +904,92 @@ class miniStringBasedNTupler : public NTupler {
 	}
       }
 
-      typedef std::vector<std::string>::const_iterator comments_const_iterator;
+      typedef std::vector<std::string>::const_reverse_iterator comments_const_iterator;
 //      using namespace edm;
 
+      // the last LHE comment with "model": its hash, the model_id of the modelPoints tree, -1 without one
       edm::Handle<LHEEventProduct> product;
-      *model_params_ = "NULL";
+      const std::string * model = 0;
       if(iEvent.getByLabel("source", product)) { 
-        comments_const_iterator c_begin = product->comments_begin();
-        comments_const_iterator c_end = product->comments_end();
+        comments_const_iterator c_begin(product->comments_end());
+        comments_const_iterator c_end(product->comments_begin());
 
-        for( comments_const_iterator cit=c_begin; cit!=c_end; ++cit) {
+        for( comments_const_iterator cit=c_begin; cit!=c_end && !model; ++cit) {
           size_t found = (*cit).find("model");
-          if( found != std::string::npos)   {
-             //std::cout << *cit << std::endl;  
-             *model_params_ = *cit;
-          }
+          if( found != std::string::npos) model = &*cit;
         } 
       }
+      *model_id_ = model ? Long64_t(modelPoints_.index(*run_, *lumiblock_, *model)) : -1;
+      if (modelParamsPerEvent_) *model_params_ = model ? *model : "NULL";
+
 
+      laps.lap(eventInfoTimer_);
 
       if (ownTheTree_){	tree_->Fill(); }
+      laps.lap(treeFillTimer_);
     }else{
-      // loop the automated leafer
+      // the event takes ownership of the vectors: they cannot be reused
+      fillCollections(iEvent, false, nAllocations);
+      // then put them in the event, one collection after the other
       Branches::iterator iB=branches_.begin();
       Branches::iterator iB_end=branches_.end();
-      for(;iB!=iB_end;++iB){
-	std::vector<miniTreeBranch>::iterator iL=iB->second.begin();
-	std::vector<miniTreeBranch>::iterator iL_end=iB->second.end();
-	uint maxS=0;
-	for(;iL!=iL_end;++iL){
-	  miniTreeBranch & b=*iL;
-	  std::auto_ptr<std::vector<float> > branch(b.branch(iEvent));
-	  if (branch->size()>maxS) maxS=branch->size();
-	  iEvent.put(branch, b.branchName());
-	}
+      for(uint c=0;iB!=iB_end;++iB,++c){
+	std::vector<miniTreeBranch> & leaves=iB->second.leaves();
+	uint maxS=kept_[c];
+	for(uint l=0;l!=leaves.size();++l)
+	  leaves[l].buffer().put(iEvent, leaves[l].branchName());
 	//index should be put only once per branch. doe not really mattter for edm root files
 	std::auto_ptr<uint> maxN(new uint(maxS));
 	iEvent.put(maxN, iB->first);
       }
     }
+
+    //debug counter of the vectors created or grown: close to zero in steady state with reuseBuffers
+    allocationsLastEvent_=nAllocations;
+    LogDebug("miniStringBasedNTupler")<<nAllocations<<" vector allocations in this event";
   }
 
   void callBack() 
   {
-    if (useTFileService_){
-      Branches::iterator iB=branches_.begin();
-      Branches::iterator iB_end=branches_.end();
-      //de-allocate memory now: allocated in branch(...) and released to the pointer.
-      for(;iB!=iB_end;++iB){
-	std::vector<miniTreeBranch>::iterator iL=iB->second.begin();
-	std::vector<miniTreeBranch>::iterator iL_end=iB->second.end();
-	for(;iL!=iL_end;++iL){
-	  miniTreeBranch & b=*iL;
-	  delete b.dataHolderPtr();
-	}
+    //nothing to de-allocate: the leaf buffers own their vectors, and replace them in fill(...) without reuseBuffers
+  }
+
+  //number of vectors allocated or grown while filling the last event
+  uint allocationsLastEvent() const { return allocationsLastEvent_;}
+
+  //fills the leaves of all the collections, into kept_[c] the number of objects of collections_[c].
+  //Each collection only writes into its own buffers, counters and kept_ and allocations_ elements
+  void fillCollections(const edm::Event & iEvent, bool reuseBuffers, uint & nAllocations){
+    kept_.resize(collections_.size());
+    allocations_.assign(collections_.size(), 0);
+    if (parallelCollections_){
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, parallelIndices_.size(), 1),
+			[&](const tbb::blocked_range<size_t> & range){
+			  for (size_t i=range.begin();i!=range.end();++i){
+			    size_t c=parallelIndices_[i];
+			    kept_[c]=collections_[c]->fill(iEvent, reuseBuffers, allocations_[c]);
+			  }
+			});
+      //no other collection runs while these may read products or unpack objects
+      for (size_t i=0;i!=serialIndices_.size();++i){
+	size_t c=serialIndices_[i];
+	kept_[c]=collections_[c]->fill(iEvent, reuseBuffers, allocations_[c]);
       }
+    }else{
+      for (size_t c=0;c!=collections_.size();++c)
+	kept_[c]=collections_[c]->fill(iEvent, reuseBuffers, allocations_[c]);
     }
+    for (size_t c=0;c!=collections_.size();++c)
+      nAllocations+=allocations_[c];
+  }
+
+  void summarize(){
+    std::ostringstream out;
+    for (Branches::const_iterator iB=branches_.begin();iB!=branches_.end();++iB)
+      iB->second.summarize(out);
+    if (!out.str().empty())
+      edm::LogVerbatim("miniStringBasedNTupler")<<"leaves not evaluated, and compiled leaves validation (time per evaluation, string vs compiled)\n"<<out.str();
+    profiler_.report();
   }
 
   ~miniStringBasedNTupler(){
@@ -504,15 +1004,29 @@ class miniStringBasedNTupler : public NTupler {
     delete weightIndex_;
     delete weightVector_;
     delete model_params_;
+    delete model_id_;
   }
     
  protected:
-  typedef std::map<std::string, std::vector<miniTreeBranch> > Branches;
+  typedef std::map<std::string, miniTreeCollection> Branches;
   Branches branches_;
+  //the collections of branches_, in the same order, and their number of kept objects and allocations in this event
+  std::vector<miniTreeCollection *> collections_;
+  std::vector<uint> kept_;
+  std::vector<uint> allocations_;
+  bool parallelCollections_;
+  //with parallelCollections, the indices in collections_ of the ones filled concurrently and of the other
+  //ones, filled after them one at a time
+  std::vector<size_t> parallelIndices_, serialIndices_;
 
   bool ownTheTree_;
   std::string treeName_;
   uint * indexDataHolder_;
+  bool reuseBuffers_;
+  uint allocationsLastEvent_;
+  std::shared_ptr<miniCompiledLeaves> compiledLeaves_;
+  miniProfiler profiler_;
+  uint fillTimer_, eventInfoTimer_, treeFillTimer_;
 
   //event info
   uint * ev_;
@@ -525,6 +1039,11 @@ class miniStringBasedNTupler : public NTupler {
   std::vector<float> * weightVector_;
   std::vector<int> * weightIndex_;
   std::string * model_params_;
+  Long64_t * model_id_;
+  bool modelParamsPerEvent_;
+
+  //the model_id of the model points, written to the modelPoints tree once per run and lumi block
+  miniStringDictionary modelPoints_;
 
 };
 
@@ -0,0 +1,86 @@
+#ifndef miniStringDictionary_H
+#define miniStringDictionary_H
+
+// MINISTRINGDICTIONARY: small integers in place of the strings of a branch (e.g. the collection of the
+//                       trigger objects). The integer of a string is a hash of it, the same in every job
+//                       whatever the order of the events, so that the outputs of several jobs can be
+//                       merged; two strings of a job with the same hash are an error. Each string is
+//                       written once per run (or per lumi block), when first met in it, to a TTree with
+//                       the run, the index and the name.
+
+#include "FWCore/Utilities/interface/Exception.h"
+#include "TTree.h"
+
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+
+class miniStringDictionary {
+ public:
+  miniStringDictionary() : tree_(0), perLumi_(false), run_(0), lumi_(0), index_(0), namePtr_(&name_) {}
+
+  //the table is written to tree, if any (owned by the TFileService). With perLumi it has a lumiblock branch
+  //and a string is written once per lumi block it is met in
+  void book(TTree * tree, bool perLumi=false, const std::string & indexName="index", const std::string & nameName="name"){
+    tree_=tree;
+    perLumi_=perLumi;
+    tree_->Branch("run",&run_,"run/i");
+    if (perLumi_) tree_->Branch("lumiblock",&lumi_,"lumiblock/i");
+    tree_->Branch(indexName.c_str(),&index_,(indexName+"/i").c_str());
+    tree_->Branch(nameName.c_str(),&namePtr_);
+  }
+
+  //the index of name, written to the table of run when first met in it
+  unsigned int index(unsigned int run, const std::string & name){ return index(run, 0, name);}
+
+  //the index of name, written to the table of run (and lumi block, if booked per lumi) when first met in it
+  unsigned int index(unsigned int run, unsigned int lumi, const std::string & name){
+    if (!perLumi_) lumi=0;
+    std::unordered_map<std::string, unsigned int>::const_iterator entry=indices_.find(name);
+    if (entry==indices_.end()){
+      unsigned int index=hash(name);
+      std::pair<std::unordered_map<unsigned int, std::string>::const_iterator, bool> added=names_.insert(std::make_pair(index, name));
+      if (!added.second)
+	throw cms::Exception("LogicError") << "miniStringDictionary: " << name << " and " << added.first->second
+					   << " have the same index " << index;
+      entry=indices_.insert(std::make_pair(name, index)).first;
+    }
+    if (written_.insert(std::make_tuple(run, lumi, entry->second)).second && tree_){
+      run_=run;
+      lumi_=lumi;
+      index_=entry->second;
+      name_=name;
+      tree_->Fill();
+    }
+    return entry->second;
+  }
+
+  //32 bits FNV-1a, which does not depend on the platform
+  static unsigned int hash(const std::string & name){
+    unsigned int h=2166136261u;
+    for (std::string::const_iterator c=name.begin();c!=name.end();++c){
+      h^=static_cast<unsigned char>(*c);
+      h*=16777619u;
+    }
+    return h;
+  }
+
+ private:
+  //the branch addresses are members
+  miniStringDictionary(const miniStringDictionary &);
+  miniStringDictionary & operator=(const miniStringDictionary &);
+
+  TTree * tree_;
+  bool perLumi_;
+  std::unordered_map<std::string, unsigned int> indices_;
+  std::unordered_map<unsigned int, std::string> names_;
+  //the (run, lumi block, index) already in the tree, the lumi block being 0 if not booked per lumi
+  std::set<std::tuple<unsigned int, unsigned int, unsigned int> > written_;
+  unsigned int run_, lumi_, index_;
+  std::string name_;
+  std::string * namePtr_;
+};
+
+#endif
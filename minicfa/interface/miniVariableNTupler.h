@@ -17,12 +17,14 @@
 #include "TFile.h"
 
 #include "PhysicsTools/UtilAlgos/interface/NTupler.h"
+#include "CfANtupler/minicfa/interface/miniJobSummary.h"
+#include "CfANtupler/minicfa/interface/miniProfiler.h"
 
 #include <algorithm>
 
-class miniVariableNTupler : public NTupler{
+class miniVariableNTupler : public NTupler, public miniJobSummary {
  public:
-  miniVariableNTupler(const edm::ParameterSet& iConfig){
+  miniVariableNTupler(const edm::ParameterSet& iConfig) : profiler_("miniVariableNTupler", iConfig) {
     ownTheTree_=false;
     edm::ParameterSet variablePSet=iConfig.getParameter<edm::ParameterSet>("variablesPSet");
     if (variablePSet.getParameter<bool>("allVariables"))
@@ -50,6 +52,11 @@ class miniVariableNTupler : public NTupler{
       else
 	treeName_=iConfig.getParameter<std::string>("treeName");
     }
+
+    //one timer per variable, in the order of leaves_
+    fillTimer_=profiler_.timer("fill");
+    for (iterator i=leaves_.begin();i!=leaves_.end();++i)
+      timers_.push_back(profiler_.timer("variable "+i->first));
   }
   
   uint registerleaves(edm::ProducerBase * producer){
@@ -99,12 +106,15 @@ class miniVariableNTupler : public NTupler{
   }
   
   void fill(edm::Event& iEvent){
+    miniProfiler::Sentry sentry(&profiler_, fillTimer_);
+    profiler_.countEvent();
     if (useTFileService_){
       //fill the data holder
       iterator i=leaves_.begin();
       iterator i_end=leaves_.end();
       uint iInDataHolder=0;
       for(;i!=i_end;++i,++iInDataHolder){
+	miniProfiler::Sentry variableSentry(&profiler_, timers_[iInDataHolder]);
 	dataHolder_[iInDataHolder]=(*i->second)(iEvent);
       }
       //fill into root;
@@ -125,6 +135,10 @@ class miniVariableNTupler : public NTupler{
   }
   void callBack(){}
 
+  void summarize(){
+    profiler_.report();
+  }
+
  protected:
   typedef std::map<std::string, const CachingVariable *>::iterator iterator;
   std::map<std::string, const CachingVariable *> leaves_;
@@ -132,6 +146,10 @@ class miniVariableNTupler : public NTupler{
   bool ownTheTree_;
   std::string treeName_;
   double * dataHolder_;
+
+  miniProfiler profiler_;
+  uint fillTimer_;
+  std::vector<uint> timers_;
 };
 
 
@@ -37,6 +37,7 @@
 #include "PhysicsTools/UtilAlgos/interface/Plotter.h"
 #include "PhysicsTools/UtilAlgos/interface/NTupler.h"
 #include "PhysicsTools/UtilAlgos/interface/InputTagDistributor.h"
+#include "CfANtupler/minicfa/interface/miniJobSummary.h"
 
 //
 // class decleration
@@ -225,6 +226,9 @@ minicfa::endJob() {
   //print summary tables
   selections_->print();
   if (plotter_) plotter_->complete();
+  //and the report of the ntupler, if it has one
+  miniJobSummary * summary=dynamic_cast<miniJobSummary*>(ntupler_);
+  if (summary) summary->summarize();
 }
 
 
@@ -14,12 +14,12 @@ basicKinematicLeaves = cms.PSet(
     pz = cms.string('pz'),
     theta = cms.string('theta'),
     et = cms.string('et'),
-    status = cms.string('status')
+    status = cms.string('status:I')
 )
 
 genMatchingLeaves = cms.PSet(
-    gen_particle_id = cms.string('genParticle.pdgId'),
-    gen_particle_status = cms.string('genParticle.status'),
+    gen_particle_id = cms.string('genParticle.pdgId:I'),
+    gen_particle_status = cms.string('genParticle.status:I'),
     gen_particle_pt = cms.string('genParticle.pt'),
     gen_particle_eta = cms.string('genParticle.eta'),
     gen_particle_phi = cms.string('genParticle.phi'),
@@ -27,8 +27,8 @@ genMatchingLeaves = cms.PSet(
     ## gen_px = cms.string('genParticle.px'),
     ## gen_py = cms.string('genParticle.py'),
     ## gen_pz = cms.string('genParticle.pz'),
-    gen_mother_id = cms.string('genParticle.mother.pdgId'),
-    gen_mother_status = cms.string('genParticle.mother.status'),
+    gen_mother_id = cms.string('genParticle.mother.pdgId:I'),
+    gen_mother_status = cms.string('genParticle.mother.status:I'),
     ## gen_mother_pt = cms.string('genParticle.mother.pt'),
     ## gen_mother_eta = cms.string('genParticle.mother.eta'),
     ## gen_mother_phi = cms.string('genParticle.mother.phi'),
@@ -36,8 +36,8 @@ genMatchingLeaves = cms.PSet(
     ## gen_mother_px = cms.string('genParticle.mother.px'),
     ## gen_mother_py = cms.string('genParticle.mother.py'),
     ## gen_mother_pz = cms.string('genParticle.mother.pz'),
-    gen_grandmother_id = cms.string('genParticle.mother.mother.pdgId'),
-    gen_grandmother_status = cms.string('genParticle.mother.mother.status'),
+    gen_grandmother_id = cms.string('genParticle.mother.mother.pdgId:I'),
+    gen_grandmother_status = cms.string('genParticle.mother.mother.status:I'),
     ## gen_grandmother_pt = cms.string('genParticle.mother.mother.pt'),
     ## gen_grandmother_eta = cms.string('genParticle.mother.mother.eta'),
     ## gen_grandmother_phi = cms.string('genParticle.mother.mother.phi'),
@@ -45,8 +45,8 @@ genMatchingLeaves = cms.PSet(
     ## gen_grandmother_px = cms.string('genParticle.mother.mother.px'),
     ## gen_grandmother_py = cms.string('genParticle.mother.mother.py'),
     ## gen_grandmother_pz = cms.string('genParticle.mother.mother.pz'),
-    gen_ggrandmother_id = cms.string('genParticle.mother.mother.mother.pdgId'),
-    gen_ggrandmother_status = cms.string('genParticle.mother.mother.mother.status'),
+    gen_ggrandmother_id = cms.string('genParticle.mother.mother.mother.pdgId:I'),
+    gen_ggrandmother_status = cms.string('genParticle.mother.mother.mother.status:I'),
     ## gen_ggrandmother_pt = cms.string('genParticle.mother.mother.mother.pt'),
     ## gen_ggrandmother_eta = cms.string('genParticle.mother.mother.mother.eta'),
     ## gen_ggrandmother_phi = cms.string('genParticle.mother.mother.mother.phi'),
@@ -89,6 +89,8 @@ cfA = cms.EDFilter("minicfa",
     Ntupler = cms.PSet(
         branchesPSet = cms.PSet(
             treeName = cms.string('eventB'),
+            ## model_params (the LHE model comment) in every event, besides model_id and the modelPoints tree
+            #modelParamsPerEvent = cms.bool(True),
             pv = cms.PSet(
                 src = cms.InputTag("offlineSlimmedPrimaryVertices"),
                  leaves = cms.PSet(
@@ -101,8 +103,8 @@ cfA = cms.EDFilter("minicfa",
                           'zErr:zError',
                           'chi2:chi2',
                           'ndof:ndof',
-                          'isFake:isFake',               
-                          'isValid:isValid'											 
+                          'isFake:isFake:O',               
+                          'isValid:isValid:O'											 
                		),
                ),
                Class = cms.string('reco::Vertex'),
@@ -140,7 +142,7 @@ cfA = cms.EDFilter("minicfa",
                     basicKinematicLeaves,
                   #  genMatchingLeaves,
                     vars = cms.vstring(
-                        'tkHits:track.hitPattern.numberOfValidHits', 
+                        'tkHits:track.hitPattern.numberOfValidHits:I', 
                         'cIso:caloIso', 
                         'tIso:trackIso',
                         'ecalIso:ecalIso',
@@ -160,12 +162,12 @@ cfA = cms.EDFilter("minicfa",
                         'iso03_emEt:isolationR03.emEt',
                         'iso03_hadEt:isolationR03.hadEt',
                         'iso03_hoEt:isolationR03.hoEt',
-                        'iso03_nTracks:isolationR03.nTracks',
+                        'iso03_nTracks:isolationR03.nTracks:I',
                         'iso05_sumPt:isolationR05.sumPt',
                         'iso05_emEt:isolationR05.emEt',
                         'iso05_hadEt:isolationR05.hadEt',
                         'iso05_hoEt:isolationR05.hoEt',
-                        'iso05_nTracks:isolationR05.nTracks',
+                        'iso05_nTracks:isolationR05.nTracks:I',
                         'pfIsolationR03_sumChargedHadronPt:pfIsolationR03.sumChargedHadronPt',
                         'pfIsolationR03_sumChargedParticlePt:pfIsolationR03.sumChargedParticlePt',
                         'pfIsolationR03_sumNeutralHadronEt:pfIsolationR03.sumNeutralHadronEt',
@@ -180,10 +182,10 @@ cfA = cms.EDFilter("minicfa",
                         'pfIsolationR04_sumPhotonEt:pfIsolationR04.sumPhotonEt',
                         'pfIsolationR04_sumPhotonEtHighThreshold:pfIsolationR04.sumPhotonEtHighThreshold',
                         'pfIsolationR04_sumPUPt:pfIsolationR04.sumPUPt',
-                        'charge:charge', 
+                        'charge:charge:I', 
                         'cm_chi2:combinedMuon.chi2', 
                         'cm_ndof:combinedMuon.ndof', 
-                        'cm_chg:combinedMuon.charge', 
+                        'cm_chg:combinedMuon.charge:I', 
                         'cm_pt:combinedMuon.pt', 
                         'cm_px:combinedMuon.px', 
                         'cm_py:combinedMuon.py', 
@@ -207,7 +209,7 @@ cfA = cms.EDFilter("minicfa",
                         'tk_id:track.key',
                         'tk_chi2:track.chi2',
                         'tk_ndof:track.ndof', 
-                        'tk_chg:track.charge', 
+                        'tk_chg:track.charge:I', 
                         'tk_pt:track.pt', 
                         'tk_px:track.px', 
                         'tk_py:track.py', 
@@ -231,7 +233,7 @@ cfA = cms.EDFilter("minicfa",
                         'tk_numpixelWthMeasr:track.hitPattern.pixelLayersWithMeasurement',
                         'stamu_chi2:standAloneMuon.chi2', 
                         'stamu_ndof:standAloneMuon.ndof', 
-                        'stamu_chg:standAloneMuon.charge', 
+                        'stamu_chg:standAloneMuon.charge:I', 
                         'stamu_pt:standAloneMuon.pt', 
                         'stamu_px:standAloneMuon.px', 
                         'stamu_py:standAloneMuon.py', 
@@ -252,10 +254,10 @@ cfA = cms.EDFilter("minicfa",
                         'stamu_etaErr:standAloneMuon.etaError', 
                         'stamu_phiErr:standAloneMuon.phiError', 
                         'num_matches:numberOfMatches',
-                        'isPFMuon:isPFMuon',
-                        'isTrackerMuon:isTrackerMuon',
-                        'isStandAloneMuon:isStandAloneMuon',
-                        'isGlobalMuon:isGlobalMuon',
+                        'isPFMuon:isPFMuon:O',
+                        'isTrackerMuon:isTrackerMuon:O',
+                        'isStandAloneMuon:isStandAloneMuon:O',
+                        'isGlobalMuon:isGlobalMuon:O',
                         'id_All:isGood("All")',
                         'id_AllGlobalMuons:isGood("AllGlobalMuons")',
                         'id_AllStandAloneMuons:isGood("AllStandAloneMuons")',
@@ -369,7 +371,7 @@ cfA = cms.EDFilter("minicfa",
                 src = cms.InputTag("prunedGenParticles"),
                 leaves = cms.PSet(
                     vars = cms.vstring(
-                        'id:pdgId',
+                        'id:pdgId:I',
                         'pt:pt',
                         'px:px',
                         'py:py',
@@ -378,11 +380,11 @@ cfA = cms.EDFilter("minicfa",
                         'phi:phi',
                         'theta:theta',
                         'energy:energy',
-                        'status:status',
-                        'charge:charge',
-                        'mother_id:mother.pdgId',
-                        'grandmother_id:mother.mother.pdgId',
-                        'ggrandmother_id:mother.mother.mother.pdgId',
+                        'status:status:I',
+                        'charge:charge:I',
+                        'mother_id:mother.pdgId:I',
+                        'grandmother_id:mother.mother.pdgId:I',
+                        'ggrandmother_id:mother.mother.mother.pdgId:I',
                         'mother_pt:mother.pt',
                         'vertex_x:vertex.x',
                         'vertex_y:vertex.y',
@@ -400,15 +402,15 @@ cfA = cms.EDFilter("minicfa",
                 src = cms.InputTag("packedGenParticles"),
                 leaves = cms.PSet(
                     vars = cms.vstring(
-                        'id:pdgId',
+                        'id:pdgId:I',
                         'pt:pt',
                         'eta:eta',
                         'phi:phi',
                         'energy:energy',
-                        'charge:charge',
-                        'mother_id:mother.pdgId',
-                        'grandmother_id:mother.mother.pdgId',
-                        'ggrandmother_id:mother.mother.mother.pdgId',
+                        'charge:charge:I',
+                        'mother_id:mother.pdgId:I',
+                        'grandmother_id:mother.mother.pdgId:I',
+                        'ggrandmother_id:mother.mother.mother.pdgId:I',
                         #'vertex_x:vertex.x',
                         #'vertex_y:vertex.y',
                         #'vertex_z:vertex.z',
@@ -424,7 +426,7 @@ cfA = cms.EDFilter("minicfa",
                      basicKinematicLeaves,
                     # genMatchingLeaves,
                      vars = cms.vstring(
-                         'charge:charge',
+                         'charge:charge:I',
                          'leadChargedHadrCand_pt:leadChargedHadrCand.pt',
                          'leadChargedHadrCand_charge:leadChargedHadrCand.charge',
                          'leadChargedHadrCand_eta:leadChargedHadrCand.eta',
@@ -458,7 +460,7 @@ cfA = cms.EDFilter("minicfa",
                         'hcalIso:hcalIso',
                         'chi2:gsfTrack.chi2', 
 #                        'class:classification', 
-                        'charge:charge', 
+                        'charge:charge:I', 
                         'caloEnergy:caloEnergy',
                         'hadOverEm:hadronicOverEm',
                         'hcalOverEcalBc:hcalOverEcalBc', 
@@ -501,7 +503,7 @@ cfA = cms.EDFilter("minicfa",
                         'dzError:gsfTrack.dzError', 
                         'etaError:gsfTrack.etaError', 
                         'phiError:gsfTrack.phiError', 
-                        'tk_charge:gsfTrack.charge',
+                        'tk_charge:gsfTrack.charge:I',
                         'core_ecalDrivenSeed:core.ecalDrivenSeed',
 #                        'n_inner_layer:gsfTrack.trackerExpectedHitsInner.numberOfHits',
 #                        'n_outer_layer:gsfTrack.trackerExpectedHitsOuter.numberOfHits',
@@ -629,7 +631,7 @@ cfA = cms.EDFilter("minicfa",
                         'eta:eta',
                         'phi:phi',
                         'energy:energy',
-                        'charge:charge',
+                        'charge:charge:I',
                         'dz:dz',
                         'dxy:dxy',
                         'fromPV:fromPV'
@@ -640,8 +642,35 @@ cfA = cms.EDFilter("minicfa",
             ),
         ),
         ComponentName = cms.string('miniCompleteNTupler'),
-        AdHocNPSet = cms.PSet(treeName = cms.string('eventA')),
+        AdHocNPSet = cms.PSet(treeName = cms.string('eventA'),
+                              ## fat jets <name>_pt, ... clustered from the skinny jets; by default only fjets30
+                              #fatJets = cms.VPSet(
+                              #    cms.PSet(name = cms.string('fjets30'), R = cms.double(1.2), ptThreshold = cms.double(30)),
+                              #    cms.PSet(name = cms.string('fjets30_R08'), R = cms.double(0.8), ptThreshold = cms.double(30),
+                              #             algorithm = cms.string('antikt'), maxEta = cms.double(2.5)),
+                              #),
+                              ## trigger_name, trigger_decision and standalone_triggerobject_collectionname in every event,
+                              ## besides trigger_menu, trigger_bits and standalone_triggerobject_collection
+                              #triggerNamesPerEvent = cms.bool(True),
+                              ## bit i of standalone_triggerobject_paths: the object fired a path starting with triggerObjectPaths[i]
+                              ## (the paths of the objects are packed in miniAOD, with no accessor in this release: with paths here,
+                              ##  or in triggerObjectSelection, each object kept is copied into a scratch object to unpack them)
+                              #triggerObjectPaths = cms.vstring('HLT_Ele27_eta2p1_WP85_Gsf_v', 'HLT_IsoMu24_eta2p1_IterTrk02_v'),
+                              ## trigger objects kept: pt > minPt and, if any list is given, fired one of the paths (prefixes),
+                              ## passed one of the filters or is in one of the collections (prefixes); all by default
+                              #triggerObjectSelection = cms.PSet(minPt = cms.double(10),
+                              #                                  paths = cms.vstring('HLT_Ele27_eta2p1_WP85_Gsf_v'),
+                              #                                  filters = cms.vstring('hltL3crIsoL1sMu20Eta2p1L1f0L2f10QL3f24QL3trkIsoFiltered0p09'),
+                              #                                  collections = cms.vstring('hltL3MuonCandidates')),
+                              ## tau discriminators taus_<name>, vector<bool> or vector<float> with ':F'; by default the
+                              ## combined isolation delta beta 3 hits ones, all vector<bool>
+                              #tauIDs = cms.vstring('byCombinedIsolationDeltaBetaCorrRaw3Hits', 'byLooseCombinedIsolationDeltaBetaCorr3Hits',
+                              #                     'byMediumCombinedIsolationDeltaBetaCorr3Hits', 'byTightCombinedIsolationDeltaBetaCorr3Hits',
+                              #                     'againstMuonTight3', 'againstElectronLooseMVA5', 'decayModeFinding',
+                              #                     'byIsolationMVA3oldDMwLTraw:F'),
+                              ),
         useTFileService = cms.bool(True), ## false for EDM; true for non EDM
+        profile = cms.untracked.bool(False), ## time per leaf, collection and ad hoc block, printed at the end of the job
     )
 )
 
@@ -6,6 +6,10 @@
 import FWCore.ParameterSet.Config as cms
 process = cms.Process("MinicfA")
 process.load("FWCore.MessageService.MessageLogger_cfi")
+## the messages of the L1 block of eventA (e.g. no gtDigis in miniAOD, once per run): the first 5, then one in 1000
+process.MessageLogger.categories.append('miniAdHocNTuplerL1')
+process.MessageLogger.cerr.miniAdHocNTuplerL1 = cms.untracked.PSet(limit = cms.untracked.int32(5),
+                                                                    reportEvery = cms.untracked.int32(1000))
 process.maxEvents = cms.untracked.PSet( input = cms.untracked.int32(100) )
 
 process.source = cms.Source("PoolSource",
@@ -37,7 +41,10 @@ process.trackIsolationMaker = cms.EDProducer("TrackIsolationMaker",
                                              dR_ConeSize = cms.double(0.3),
                                              dz_CutValue = cms.double(0.05),
                                              minPt_PFCandidate = cms.double(5.0), #looser than the likely analysis selection
-                                             maxIso_PFCandidate = cms.double(0.25) #very loose
+                                             maxIso_PFCandidate = cms.double(0.25), #very loose
+                                             dR_ConeSizes = cms.vdouble(), #e.g. (0.1, 0.2, 0.4): pfcandstrkiso0p1, ... in the same pass
+                                             miniIsolation = cms.bool(False), #pfcandsminiiso, cone of 10 GeV/pt
+                                             #parallelIsolation = cms.untracked.bool(True), #the candidates shared among the tbb threads
 )
 
 process.p = cms.Path(process.trackIsolationMaker)
@@ -0,0 +1,243 @@
+#!/usr/bin/env python
+# Writes the compiled leaves plugin of a branchesPSet: every leaf expression that is a plain chain
+# of member calls (e.g. 'combinedMuon.pt', 'userFloat("x")', 'position.x') becomes a C++ function
+# calling these members directly. The members and their return types are looked up in the ROOT
+# dictionaries, so run it from a CMSSW area (cmsenv). Anything else (arithmetic, functions of the
+# expression language, unknown members, ...) is left to the string evaluator of miniStringBasedNTupler.
+#
+#   python CfANtupler/minicfa/scripts/generateCompiledLeaves.py
+#   scram b
+#
+# and set in the branchesPSet:
+#   compiledLeaves = cms.untracked.string('miniCompiledLeaves_cfA')
+#   validateCompiledLeaves = cms.untracked.bool(True)  # optional, compares both evaluators on every leaf
+
+from __future__ import print_function
+import importlib
+import optparse
+import re
+import sys
+
+import FWCore.ParameterSet.Config as cms
+
+parser = optparse.OptionParser()
+parser.add_option('--cfi', default='CfANtupler.minicfa.branchesminicfA_cfi',
+                  help='python module with the configuration')
+parser.add_option('--module', default='cfA', help='the minicfa module of the configuration')
+parser.add_option('--name', default='miniCompiledLeaves_cfA', help='name of the plugin')
+parser.add_option('--separator', default=':', help='separator of the vars leaves')
+parser.add_option('-o', '--output', default=None,
+                  help='output file (default: CfANtupler/minicfa/plugins/<name>.cc)')
+(options, args) = parser.parse_args()
+
+import ROOT
+ROOT.gROOT.SetBatch(True)
+ROOT.gSystem.Load('libFWCoreFWLite')
+ROOT.AutoLibraryLoader.enable()
+
+TYPES = 'BSIFDO'
+ARITHMETIC = set(['bool', 'char', 'signed char', 'unsigned char', 'short', 'unsigned short',
+                  'int', 'unsigned int', 'long', 'unsigned long', 'long long', 'unsigned long long',
+                  'float', 'double', 'Char_t', 'UChar_t', 'Short_t', 'UShort_t', 'Int_t', 'UInt_t',
+                  'Long_t', 'ULong_t', 'Long64_t', 'ULong64_t', 'Float_t', 'Double_t', 'Bool_t',
+                  'size_t', 'uint8_t', 'uint16_t', 'uint32_t', 'uint64_t', 'int8_t', 'int16_t',
+                  'int32_t', 'int64_t'])
+REFERENCES = ('edm::Ref<', 'edm::Ptr<', 'edm::RefToBase<')
+
+
+def split_type(expr, separator):
+    """same as miniTreeBranch::splitType"""
+    if len(expr) <= len(separator) + 1:
+        return expr
+    if expr[-1] in TYPES and expr[-1 - len(separator):-1] == separator:
+        return expr[:-1 - len(separator)]
+    return expr
+
+
+def leaves_of(branchesPSet, separator):
+    """(class, expression) of all the leaves, as miniStringBasedNTupler reads them"""
+    leaves = []
+    for name, branch in branchesPSet.parameters_().items():
+        if not isinstance(branch, cms.PSet) or not hasattr(branch, 'leaves'):
+            continue
+        className = branch.Class.value() if hasattr(branch, 'Class') else getattr(branch, 'class').value()
+        for lname, leaf in branch.leaves.parameters_().items():
+            if isinstance(leaf, cms.string):
+                leaves.append((className, split_type(leaf.value(), separator)))
+        if hasattr(branch.leaves, 'vars'):
+            for var in branch.leaves.vars:
+                leaves.append((className, split_type(var[var.find(separator) + len(separator):], separator)))
+    return leaves
+
+
+def split_hops(expr):
+    """'a.b("x.y").c' -> ['a', 'b("x.y")', 'c'], or None if this is not a chain of members"""
+    hops, depth, quote, current = [], 0, None, ''
+    for c in expr.strip():
+        if quote:
+            quote = None if c == quote else quote
+        elif c in '"\'':
+            quote = c
+        elif c == '(':
+            depth += 1
+        elif c == ')':
+            depth -= 1
+        elif c == '.' and depth == 0:
+            hops.append(current)
+            current = ''
+            continue
+        current += c
+    hops.append(current)
+    member = re.compile(r'^([A-Za-z_]\w*)(\((.*)\))?$')
+    parsed = []
+    for hop in hops:
+        m = member.match(hop.strip())
+        if not m:
+            return None
+        arguments = m.group(3)
+        if arguments is not None and arguments.strip() != '':
+            # only literal arguments: one string or numbers
+            arguments = [a.strip() for a in arguments.split(',')] if arguments[0] not in '"\'' else [arguments.strip()]
+            for a in arguments:
+                if not (re.match(r'^("[^"]*"|\'[^\']*\')$', a) or re.match(r'^-?[0-9.]+([eE]-?[0-9]+)?$', a)):
+                    return None
+            arguments = ['"%s"' % a[1:-1] if a[0] == "'" else a for a in arguments]
+        else:
+            arguments = []
+        parsed.append((m.group(1), arguments))
+    return parsed
+
+
+def template_arguments(name):
+    """'edm::Ref<A<B,C>,D>' -> ['A<B,C>', 'D']"""
+    inner = name[name.find('<') + 1:name.rfind('>')]
+    arguments, depth, current = [], 0, ''
+    for c in inner:
+        if c == ',' and depth == 0:
+            arguments.append(current.strip())
+            current = ''
+            continue
+        depth += (c == '<') - (c == '>')
+        current += c
+    arguments.append(current.strip())
+    return arguments
+
+
+def bare(typeName):
+    return re.sub(r'\bconst\b', '', typeName).replace('&', '').strip()
+
+
+class Hop(object):
+    """a member of a class: its C++ call, what it returns and how to go on from it"""
+    def __init__(self, call, typeName):
+        self.call = call
+        self.typeName = bare(typeName)
+        self.pointer = self.typeName.endswith('*')
+        if self.pointer:
+            self.typeName = self.typeName[:-1].strip()
+        self.reference = False
+        self.target = None
+        if self.typeName in ARITHMETIC:
+            return
+        tclass = ROOT.TClass.GetClass(self.typeName)
+        if tclass:
+            self.typeName = tclass.GetName()
+        if not self.pointer and self.typeName.startswith(REFERENCES):
+            self.reference = True
+            arguments = template_arguments(self.typeName)
+            # edm::Ref<Collection, T, ...> and edm::Ptr<T>, edm::RefToBase<T>
+            self.target = arguments[1] if self.typeName.startswith('edm::Ref<') and len(arguments) > 1 else arguments[0]
+        else:
+            self.target = self.typeName
+
+    def arithmetic(self):
+        return self.typeName in ARITHMETIC and not self.pointer
+
+
+def find_member(className, name, arguments):
+    tclass = ROOT.TClass.GetClass(className)
+    if not tclass or not tclass.HasDictionary():
+        return None, None
+    method = tclass.GetMethod(name, ','.join(arguments))
+    if method:
+        return Hop('%s(%s)' % (name, ', '.join(arguments)), method.GetReturnTypeName()), tclass
+    if not arguments:
+        member = tclass.GetDataMember(name)
+        if member and member.Property() & ROOT.kIsPublic:
+            return Hop(name, member.GetFullTypeName()), tclass
+    return None, None
+
+
+def compile_leaf(className, expr, function, includes):
+    """the C++ function for expr on className, or None"""
+    hops = split_hops(expr)
+    if not hops:
+        return None
+    body = ['  const %s & o0=*static_cast<const %s*>(object);' % (className, className)]
+    current, access = className, 'o0.'
+    for i, (name, arguments) in enumerate(hops):
+        hop, tclass = find_member(current, name, arguments)
+        if not hop:
+            return None
+        include = tclass.GetDeclFileName()
+        if include:
+            includes.add(re.sub(r'^.*/src/', '', include))
+        last = (i == len(hops) - 1)
+        if last:
+            if not hop.arithmetic():
+                return None
+            body.append('  value=static_cast<double>(%s%s);' % (access, hop.call))
+            break
+        if hop.arithmetic() or hop.target is None:
+            return None
+        o = 'o%d' % (i + 1)
+        if hop.pointer:
+            body.append('  const %s * %s=%s%s;' % (hop.target, o, access, hop.call))
+            body.append('  if (!%s) return false;' % o)
+            access = o + '->'
+        elif hop.reference:
+            body.append('  const %s %s=%s%s;' % (hop.typeName, o, access, hop.call))
+            body.append('  if (%s.isNull() || !%s.isAvailable()) return false;' % (o, o))
+            access = o + '->'
+        else:
+            body.append('  const %s & %s=%s%s;' % (hop.typeName, o, access, hop.call))
+            access = o + '.'
+        current = hop.target
+    return ('//%s on %s\nbool %s(const void * object, double & value){\n%s\n  return true;\n}\n'
+            % (expr, className, function, '\n'.join(body)))
+
+
+def main():
+    module = importlib.import_module(options.cfi)
+    branchesPSet = getattr(module, options.module).Ntupler.branchesPSet
+    includes, functions, registrations, skipped, done = set(), [], [], [], set()
+    for className, expr in leaves_of(branchesPSet, options.separator):
+        if (className, expr) in done:
+            continue
+        done.add((className, expr))
+        function = 'leaf%d' % len(functions)
+        code = compile_leaf(className, expr, function, includes)
+        if code is None:
+            skipped.append('%s::%s' % (className, expr))
+            continue
+        functions.append(code)
+        registrations.append('    add("%s", "%s", &%s);' % (className, expr.replace('"', '\\"'), function))
+
+    output = options.output or 'CfANtupler/minicfa/plugins/%s.cc' % options.name
+    with open(output, 'w') as f:
+        f.write('// generated by minicfa/scripts/generateCompiledLeaves.py from %s, do not edit\n\n' % options.cfi)
+        f.write('#include "CfANtupler/minicfa/interface/miniCompiledLeaves.h"\n')
+        for include in sorted(includes):
+            f.write('#include "%s"\n' % include)
+        f.write('\nnamespace {\n\n%s\n}\n\n' % '\n'.join(functions))
+        f.write('class %s : public miniCompiledLeaves {\n public:\n  %s(){\n%s\n  }\n};\n\n'
+                % (options.name, options.name, '\n'.join(registrations)))
+        f.write('DEFINE_EDM_PLUGIN(miniCompiledLeavesFactory, %s, "%s");\n' % (options.name, options.name))
+
+    print('%s: %d leaves compiled, %d left to the string evaluator' % (output, len(functions), len(skipped)))
+    for leaf in skipped:
+        print('  not compiled: %s' % leaf)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,3 @@
+#include "CfANtupler/minicfa/interface/miniCompiledLeaves.h"
+
+EDM_REGISTER_PLUGINFACTORY(miniCompiledLeavesFactory, "miniCompiledLeavesFactory");
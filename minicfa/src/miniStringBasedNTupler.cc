@@ -1,5 +1,13 @@
 #include "CfANtupler/minicfa/interface/miniStringBasedNTupler.h"
 
+#include <cctype>
+#include <type_traits>
+
+#include "FWCore/Utilities/interface/BaseWithDict.h"
+#include "FWCore/Utilities/interface/FunctionWithDict.h"
+#include "FWCore/Utilities/interface/MemberWithDict.h"
+#include "FWCore/Utilities/interface/TypeWithDict.h"
+
 #include "DataFormats/PatCandidates/interface/Jet.h"
 #include "DataFormats/PatCandidates/interface/Muon.h"
 #include "DataFormats/PatCandidates/interface/MET.h"
@@ -31,48 +39,344 @@
 #include "DataFormats/PatCandidates/interface/PackedGenParticle.h"
 #include <SimDataFormats/GeneratorProducts/interface/GenEventInfoProduct.h>
 
+#include "DataFormats/TrackReco/interface/Track.h"
+#include "DataFormats/GsfTrackReco/interface/GsfTrack.h"
+#include "DataFormats/EgammaReco/interface/SuperCluster.h"
+#include "DataFormats/Candidate/interface/Candidate.h"
+#include "DataFormats/MuonReco/interface/MuonIsolation.h"
+#include "DataFormats/MuonReco/interface/MuonPFIsolation.h"
+#include "DataFormats/TrackReco/interface/HitPattern.h"
+
 
 //--------------------------------------------------------------------------------
 //just define here a list of objects you would like to be able to have a branch of
 //--------------------------------------------------------------------------------
-#define MINIANOTHER_VECTOR_CLASS(C) if (class_==#C) return StringBranchHelper<C>(*this, iEvent)()
-#define MINIANOTHER_CLASS(C) if (class_==#C) return StringLeaveHelper<C>(*this, iEvent)()
+template <typename Helper>
+miniBranchHelper * makeMiniBranchHelper(const std::vector<miniTreeBranch> & leaves, const miniEvaluationOptions & options){
+  return new Helper(leaves, options);
+}
 
-miniTreeBranch::value miniTreeBranch::branch(const edm::Event& iEvent){
+#define MINIANOTHER_VECTOR_CLASS(C) factories_[#C]=&makeMiniBranchHelper<StringBranchHelper<C> >
+#define MINIANOTHER_CLASS(C) factories_[#C]=&makeMiniBranchHelper<StringLeaveHelper<C> >
+
+miniBranchHelperRegistry::miniBranchHelperRegistry(){
   MINIANOTHER_VECTOR_CLASS(pat::Jet);
-  else MINIANOTHER_VECTOR_CLASS(pat::Muon);
-  else MINIANOTHER_VECTOR_CLASS(reco::GenParticle);
-  else MINIANOTHER_VECTOR_CLASS(pat::Electron);
-  else MINIANOTHER_VECTOR_CLASS(pat::MET);
-  else MINIANOTHER_VECTOR_CLASS(pat::Tau);
-  else MINIANOTHER_VECTOR_CLASS(pat::Hemisphere);
-  else MINIANOTHER_VECTOR_CLASS(pat::Photon);
-  else MINIANOTHER_VECTOR_CLASS(reco::CaloMET);
-  else MINIANOTHER_VECTOR_CLASS(reco::Muon);
-  else MINIANOTHER_VECTOR_CLASS(reco::Track);
-  else MINIANOTHER_VECTOR_CLASS(reco::GsfElectron);
-  else MINIANOTHER_VECTOR_CLASS(SimTrack);
-  else MINIANOTHER_VECTOR_CLASS(l1extra::L1ParticleMap);
-  else MINIANOTHER_VECTOR_CLASS(reco::Vertex);
-  else MINIANOTHER_VECTOR_CLASS(pat::GenericParticle);
-  else MINIANOTHER_VECTOR_CLASS(reco::MET);
-  else MINIANOTHER_CLASS(edm::HepMCProduct);
-  else MINIANOTHER_CLASS(reco::BeamSpot);
-  else MINIANOTHER_CLASS(HcalNoiseSummary);
-  else MINIANOTHER_CLASS(GenEventInfoProduct);
-  else MINIANOTHER_VECTOR_CLASS(reco::HcalNoiseRBX);
-  else MINIANOTHER_VECTOR_CLASS(reco::BasicJet);
-  else MINIANOTHER_VECTOR_CLASS(reco::CaloJet);
-  else MINIANOTHER_VECTOR_CLASS(reco::GenJet);
-  else MINIANOTHER_VECTOR_CLASS(pat::TriggerPath);
-  else MINIANOTHER_VECTOR_CLASS(reco::PFCandidate);
-  else MINIANOTHER_VECTOR_CLASS(reco::CaloCluster);
-  else MINIANOTHER_VECTOR_CLASS(reco::Photon);
-  else MINIANOTHER_VECTOR_CLASS(pat::PackedCandidate);
-  else MINIANOTHER_VECTOR_CLASS(pat::PackedGenParticle);
-  else {
-    edm::LogError("miniTreeBranch")<<branchName()<<" failed to recognize class type: "<<class_<<". Shucks";
-    return miniTreeBranch::value(new std::vector<float>());
-  }
+  MINIANOTHER_VECTOR_CLASS(pat::Muon);
+  MINIANOTHER_VECTOR_CLASS(reco::GenParticle);
+  MINIANOTHER_VECTOR_CLASS(pat::Electron);
+  MINIANOTHER_VECTOR_CLASS(pat::MET);
+  MINIANOTHER_VECTOR_CLASS(pat::Tau);
+  MINIANOTHER_VECTOR_CLASS(pat::Hemisphere);
+  MINIANOTHER_VECTOR_CLASS(pat::Photon);
+  MINIANOTHER_VECTOR_CLASS(reco::CaloMET);
+  MINIANOTHER_VECTOR_CLASS(reco::Muon);
+  MINIANOTHER_VECTOR_CLASS(reco::Track);
+  MINIANOTHER_VECTOR_CLASS(reco::GsfElectron);
+  MINIANOTHER_VECTOR_CLASS(SimTrack);
+  MINIANOTHER_VECTOR_CLASS(l1extra::L1ParticleMap);
+  MINIANOTHER_VECTOR_CLASS(reco::Vertex);
+  MINIANOTHER_VECTOR_CLASS(pat::GenericParticle);
+  MINIANOTHER_VECTOR_CLASS(reco::MET);
+  MINIANOTHER_CLASS(edm::HepMCProduct);
+  MINIANOTHER_CLASS(reco::BeamSpot);
+  MINIANOTHER_CLASS(HcalNoiseSummary);
+  MINIANOTHER_CLASS(GenEventInfoProduct);
+  MINIANOTHER_VECTOR_CLASS(reco::HcalNoiseRBX);
+  MINIANOTHER_VECTOR_CLASS(reco::BasicJet);
+  MINIANOTHER_VECTOR_CLASS(reco::CaloJet);
+  MINIANOTHER_VECTOR_CLASS(reco::GenJet);
+  MINIANOTHER_VECTOR_CLASS(pat::TriggerPath);
+  MINIANOTHER_VECTOR_CLASS(reco::PFCandidate);
+  MINIANOTHER_VECTOR_CLASS(reco::CaloCluster);
+  MINIANOTHER_VECTOR_CLASS(reco::Photon);
+  MINIANOTHER_VECTOR_CLASS(pat::PackedCandidate);
+  MINIANOTHER_VECTOR_CLASS(pat::PackedGenParticle);
 }
+#undef MINIANOTHER_VECTOR_CLASS
 #undef MINIANOTHER_CLASS
+
+const miniBranchHelperRegistry & miniBranchHelperRegistry::get(){
+  static const miniBranchHelperRegistry registry;
+  return registry;
+}
+
+std::mutex & miniBranchHelper::eventMutex(){
+  static std::mutex mutex;
+  return mutex;
+}
+
+//--------------------------------------------------------------------------------
+//the leaves that can be evaluated while the other collections are filled
+//--------------------------------------------------------------------------------
+//the objects that unpack themselves on first use, in mutable caches not safe from several threads
+//(e.g. pat::PackedCandidate::dz through unpackVtx and vertexRef)
+static bool lazilyUnpacked(const std::string & className){
+  return className=="pat::PackedCandidate" || className=="pat::PackedGenParticle";
+}
+
+//whether the arguments of a call are literals only ("'x'", "0, 1.5"), not expressions on the object
+static bool literalArguments(const std::string & args){
+  for (size_t c=0;c!=args.size();++c){
+    char ch=args[c];
+    if (ch=='\'' || ch=='"'){
+      c=args.find(ch, c+1);
+      if (c==std::string::npos) return false;
+      continue;
+    }
+    if (std::isdigit(static_cast<unsigned char>(ch)) || ch=='.' || ch=='+' || ch=='-' || ch==',' || ch==' ') continue;
+    //exponent of a number
+    if ((ch=='e' || ch=='E') && c!=0 && std::isdigit(static_cast<unsigned char>(args[c-1]))) continue;
+    return false;
+  }
+  return true;
+}
+
+//splits "track.hitPattern.numberOfValidHits" or "tauID('x')" into its members. False if expr is anything else
+static bool splitMemberChain(const std::string & expr, std::vector<std::string> & members){
+  size_t c=0;
+  while (true){
+    while (c!=expr.size() && expr[c]==' ') ++c;
+    if (c==expr.size() || !(std::isalpha(static_cast<unsigned char>(expr[c])) || expr[c]=='_')) return false;
+    size_t end=c;
+    while (end!=expr.size() && (std::isalnum(static_cast<unsigned char>(expr[end])) || expr[end]=='_')) ++end;
+    members.push_back(expr.substr(c, end-c));
+    c=end;
+    while (c!=expr.size() && expr[c]==' ') ++c;
+    if (c!=expr.size() && expr[c]=='('){
+      //the closing parenthesis, outside of the quotes
+      size_t close=c+1;
+      while (close!=expr.size() && expr[close]!=')'){
+	if (expr[close]=='\'' || expr[close]=='"'){
+	  close=expr.find(expr[close], close+1);
+	  if (close==std::string::npos) return false;
+	}
+	++close;
+      }
+      if (close==expr.size() || !literalArguments(expr.substr(c+1, close-c-1))) return false;
+      c=close+1;
+      while (c!=expr.size() && expr[c]==' ') ++c;
+    }
+    if (c==expr.size()) return true;
+    if (expr[c]!='.') return false;
+    ++c;
+  }
+}
+
+//the type of member of type or of one of its bases, an invalid type if there is none
+static edm::TypeWithDict memberType(const edm::TypeWithDict & type, const std::string & member){
+  edm::FunctionWithDict function=type.functionMemberByName(member);
+  if (function) return function.finalReturnType();
+  edm::MemberWithDict data=type.dataMemberByName(member);
+  if (data) return data.typeOf();
+  edm::TypeBases bases(type);
+  for (auto const & base : bases){
+    edm::TypeWithDict found=memberType(edm::BaseWithDict(base).typeOf(), member);
+    if (found) return found;
+  }
+  return edm::TypeWithDict();
+}
+
+bool miniConcurrentLeaf(const std::string & className, const std::string & expr){
+  if (expr.find_first_not_of(' ')==std::string::npos) return true;
+  std::vector<std::string> members;
+  if (lazilyUnpacked(className) || !splitMemberChain(expr, members)) return false;
+  edm::TypeWithDict type=edm::TypeWithDict::byName(className);
+  for (size_t m=0;m!=members.size();++m){
+    if (!type) return false;
+    edm::TypeWithDict returned=memberType(type, members[m]);
+    if (!returned) return false;
+    //a const reference to a part of the object is followed, a pointer or a reference to another product is not
+    std::string name=returned.name();
+    if (name.find('*')!=std::string::npos || name.find("Ref")!=std::string::npos || name.find("Ptr")!=std::string::npos)
+      return false;
+    if (name.compare(0, 6, "const ")==0) name.erase(0, 6);
+    name.erase(std::remove(name.begin(), name.end(), '&'), name.end());
+    name.erase(name.find_last_not_of(' ')+1);
+    if (lazilyUnpacked(name)) return false;
+    if (m+1!=members.size()) type=edm::TypeWithDict::byName(name).finalType();
+  }
+  return true;
+}
+
+void miniTreeCollection::configure(const miniEvaluationOptions & options){
+  const std::string & className=leaves_.front().className();
+  miniBranchHelperRegistry::factory make=miniBranchHelperRegistry::get().find(className);
+  if (!make)
+    throw cms::Exception("Configuration")<<leaves_.front().maxIndexName()<<" failed to recognize class type: "<<className<<". Shucks";
+  helper_.reset(make(leaves_, options));
+  profiler_=options.profiler;
+  timer_=profiler_ ? options.profiler->timer("collection "+leaves_.front().maxIndexName()) : 0;
+}
+
+miniCompiledLeafSet::miniCompiledLeafSet(const std::vector<miniTreeBranch> & leaves, const miniCompiledLeaves * compiled, bool validate) :
+  accessors_(leaves.size(), 0), validate_(validate),
+  stringTime_(leaves.size()), compiledTime_(leaves.size()), evaluations_(leaves.size(), 0), mismatches_(leaves.size(), 0) {
+  uint nCompiled=0;
+  for (uint l=0;l!=leaves.size();++l){
+    aliases_.push_back(leaves[l].branchAlias());
+    if (compiled) accessors_[l]=compiled->find(leaves[l].className(), leaves[l].expr());
+    if (accessors_[l]) ++nCompiled;
+  }
+  if (compiled)
+    edm::LogInfo("miniCompiledLeafSet")<<leaves.front().maxIndexName()<<": "<<nCompiled<<" of "<<leaves.size()<<" leaves compiled";
+}
+
+void miniCompiledLeafSet::summarize(std::ostream & out) const {
+  if (!validate_) return;
+  for (uint l=0;l!=accessors_.size();++l){
+    if (!accessors_[l] || evaluations_[l]==0) continue;
+    double stringNs=std::chrono::duration<double, std::nano>(stringTime_[l]).count()/evaluations_[l];
+    double compiledNs=std::chrono::duration<double, std::nano>(compiledTime_[l]).count()/evaluations_[l];
+    out<<aliases_[l]<<": "<<evaluations_[l]<<" evaluations, "<<stringNs<<" ns vs "<<compiledNs<<" ns, "
+       <<mismatches_[l]<<" mismatches\n";
+  }
+}
+
+//--------------------------------------------------------------------------------
+//the members followed without the string evaluator, and the classes they lead to:
+//the ones that return a null reference often enough to not be left to exceptions,
+//and the ones returning a const reference to a part of the object shared by many leaves
+//--------------------------------------------------------------------------------
+#define MININULLABLE_POINTER(C, M, T) hops_[#C "::" #M]=miniHop(#T, [](const void * o)->const void * { \
+      return static_cast<const C*>(o)->M();})
+#define MININULLABLE_REF(C, M, T) hops_[#C "::" #M]=miniHop(#T, [](const void * o)->const void * { \
+      auto ref=static_cast<const C*>(o)->M();				\
+      return (ref.isNull() || !ref.isAvailable()) ? 0 : &*ref;})
+//M has to return a reference to a data member of C, not a copy: the address of a copy would dangle
+#define MINIMEMBER_REF(C, M, T) hops_[#C "::" #M]=miniHop(#T, [](const void * o)->const void * { \
+      static_assert(std::is_reference<decltype(static_cast<const C*>(0)->M())>::value, \
+		    "MINIMEMBER_REF needs a member returning a reference"); \
+      const T & member=static_cast<const C*>(o)->M();			\
+      return &member;})
+#define MINILEAF_TAIL(T) tails_[#T]=&makeMiniLeafTail<T>
+
+template <typename T>
+miniLeafTail * makeMiniLeafTail(const std::string & expr){ return new miniTypedLeafTail<T>(expr);}
+
+miniHopRegistry::miniHopRegistry(){
+  MININULLABLE_POINTER(pat::Muon, genParticle, reco::GenParticle);
+  MININULLABLE_POINTER(pat::Electron, genParticle, reco::GenParticle);
+  MININULLABLE_POINTER(pat::Photon, genParticle, reco::GenParticle);
+  MININULLABLE_POINTER(pat::Tau, genParticle, reco::GenParticle);
+  MININULLABLE_POINTER(pat::Jet, genParticle, reco::GenParticle);
+  MININULLABLE_POINTER(pat::Jet, genParton, reco::GenParticle);
+  MININULLABLE_POINTER(pat::Jet, genJet, reco::GenJet);
+  MININULLABLE_POINTER(reco::GenParticle, mother, reco::Candidate);
+  MININULLABLE_POINTER(pat::PackedGenParticle, mother, reco::Candidate);
+  MININULLABLE_POINTER(reco::Candidate, mother, reco::Candidate);
+
+  MININULLABLE_REF(pat::Muon, combinedMuon, reco::Track);
+  MININULLABLE_REF(pat::Muon, globalTrack, reco::Track);
+  MININULLABLE_REF(pat::Muon, track, reco::Track);
+  MININULLABLE_REF(pat::Muon, innerTrack, reco::Track);
+  MININULLABLE_REF(pat::Muon, standAloneMuon, reco::Track);
+  MININULLABLE_REF(pat::Muon, outerTrack, reco::Track);
+  MININULLABLE_REF(pat::Electron, gsfTrack, reco::GsfTrack);
+  MININULLABLE_REF(pat::Electron, superCluster, reco::SuperCluster);
+  MININULLABLE_REF(pat::Photon, superCluster, reco::SuperCluster);
+
+  MINIMEMBER_REF(pat::Muon, isolationR03, reco::MuonIsolation);
+  MINIMEMBER_REF(pat::Muon, isolationR05, reco::MuonIsolation);
+  MINIMEMBER_REF(pat::Muon, pfIsolationR03, reco::MuonPFIsolation);
+  MINIMEMBER_REF(pat::Muon, pfIsolationR04, reco::MuonPFIsolation);
+  MINIMEMBER_REF(reco::Track, hitPattern, reco::HitPattern);
+  MINIMEMBER_REF(reco::GsfTrack, hitPattern, reco::HitPattern);
+
+  MINILEAF_TAIL(reco::GenParticle);
+  MINILEAF_TAIL(reco::GenJet);
+  MINILEAF_TAIL(reco::Candidate);
+  MINILEAF_TAIL(reco::Track);
+  MINILEAF_TAIL(reco::GsfTrack);
+  MINILEAF_TAIL(reco::SuperCluster);
+  MINILEAF_TAIL(reco::MuonIsolation);
+  MINILEAF_TAIL(reco::MuonPFIsolation);
+  MINILEAF_TAIL(reco::HitPattern);
+}
+#undef MININULLABLE_POINTER
+#undef MININULLABLE_REF
+#undef MINIMEMBER_REF
+#undef MINILEAF_TAIL
+
+const miniHopRegistry & miniHopRegistry::get(){
+  static const miniHopRegistry registry;
+  return registry;
+}
+
+//whether expr is a plain chain of members ("track.pt", "mother().pdgId"): no operator, argument or comma,
+//after which the rest of the expression would not apply to the target of the leading hops ("track.pt/pt")
+static bool memberChain(const std::string & expr){
+  for (size_t c=0;c!=expr.size();++c){
+    char ch=expr[c];
+    if (std::isalnum(static_cast<unsigned char>(ch)) || ch=='_' || ch=='.' || ch==' ') continue;
+    //empty parentheses of a call without argument
+    if (ch=='('){
+      size_t close=expr.find_first_not_of(' ', c+1);
+      if (close!=std::string::npos && expr[close]==')'){ c=close; continue;}
+    }
+    return false;
+  }
+  return true;
+}
+
+int miniHopTree::add(const std::string & className, const std::string & expr, std::shared_ptr<const miniLeafTail> & tail){
+  const miniHopRegistry & registry=miniHopRegistry::get();
+  //anything but a member chain is left to the string evaluator of the whole expression
+  if (!memberChain(expr)) return -1;
+  //follow the leading members while they are registered ("mother" or "mother()")
+  std::vector<std::string> members;
+  std::vector<const miniHop *> hops;
+  std::vector<std::string> tails;
+  std::string target=className;
+  std::string rest=expr;
+  while (true){
+    size_t dot=rest.find('.');
+    if (dot==std::string::npos) break;
+    std::string member=rest.substr(0,dot);
+    member.erase(std::remove(member.begin(), member.end(), ' '), member.end());
+    if (member.size()>2 && member.compare(member.size()-2, 2, "()")==0) member.erase(member.size()-2);
+    const miniHop * hop=registry.find(target, member);
+    if (!hop) break;
+    members.push_back(member);
+    hops.push_back(hop);
+    target=hop->target;
+    rest=rest.substr(dot+1);
+    tails.push_back(rest);
+  }
+
+  //the deepest hop with an evaluator for the rest of the expression
+  int last=hops.size()-1;
+  for (;last>=0;--last){
+    miniHopRegistry::tailFactory makeTail=registry.findTail(hops[last]->target);
+    if (!makeTail) continue;
+    try{
+      tail.reset(makeTail(tails[last]));
+      break;
+    }catch(cms::Exception & e){
+      //left to the string evaluator of the whole expression
+      edm::LogWarning("miniHopTree")<<"cannot parse: "<<tails[last]<<" on class: "<<hops[last]->target<<" (from "<<expr<<")";
+      tail.reset();
+      return -1;
+    }
+  }
+  if (last<0) return -1;
+
+  //merge the hops with the ones of the other leaves
+  int node=-1;
+  for (int h=0;h<=last;++h){
+    int child=-1;
+    for (uint n=0;n!=nodes_.size();++n)
+      if (nodes_[n].parent==node && nodes_[n].member==members[h]) { child=n; break;}
+    if (child<0){
+      Node added;
+      added.parent=node;
+      added.member=members[h];
+      added.get=hops[h]->get;
+      nodes_.push_back(added);
+      objects_.push_back(0);
+      failed_.push_back(0);
+      child=nodes_.size()-1;
+    }
+    node=child;
+  }
+  return node;
+}